@@ -0,0 +1,73 @@
+#include "BarnesHut.hpp"
+
+#include <limits>
+
+glm::vec3 calc_acceleration_barnes_hut(const Octree& tree,
+                                       const glm::vec4* positions,
+                                       const float* masses,
+                                       glm::vec3 position,
+                                       float theta,
+                                       std::vector<uint32_t>& stack) {
+    auto& nodes = tree.get_nodes();
+    auto& order = tree.get_order();
+    auto inv_theta = theta > 0.0f ? 1.0f / theta : std::numeric_limits<float>::infinity();
+
+    glm::vec3 acc{0.0f};
+    stack.clear();
+    stack.push_back(0);
+    while(!stack.empty()) {
+        auto& node = nodes[stack.back()];
+        stack.pop_back();
+        if(node.mass == 0.0f)
+            continue;
+
+        if(node.is_leaf()) {
+            for(auto i = node.body_begin; i < node.body_end; ++i) {
+                auto id = order[i];
+                auto diff = glm::vec3(positions[id]) - position;
+                auto dist2 = glm::dot(diff, diff);
+                if(dist2 == 0.0f)
+                    continue;
+                acc += diff * (masses[id] / (dist2 * std::sqrt(dist2)));
+            }
+            continue;
+        }
+
+        auto diff = node.mass_center - position;
+        auto dist2 = glm::dot(diff, diff);
+        auto open_radius = 2.0f * node.half_size * inv_theta + node.mass_center_offset;
+        if(dist2 > open_radius * open_radius) {
+            acc += diff * (node.mass / (dist2 * std::sqrt(dist2)));
+            continue;
+        }
+
+        for(auto child = node.first_child; child < node.first_child + node.child_count; ++child)
+            stack.push_back(child);
+    }
+    return acc;
+}
+
+std::vector<glm::vec4> calc_forces_barnes_hut(const Octree& tree,
+                                              const std::vector<glm::vec4>& positions,
+                                              const std::vector<float>& masses,
+                                              size_t bodies_count,
+                                              float theta,
+                                              float G,
+                                              ThreadPool& pool) {
+    std::vector<glm::vec4> forces(bodies_count);
+
+    pool.parallel_for(0, bodies_count, [&](size_t begin, size_t end) {
+        thread_local std::vector<uint32_t> stack;
+        for(auto id = begin; id < end; ++id) {
+            auto acc = calc_acceleration_barnes_hut(tree,
+                                                    positions.data(),
+                                                    masses.data(),
+                                                    glm::vec3(positions[id]),
+                                                    theta,
+                                                    stack);
+            forces[id] = glm::vec4(acc * (G * masses[id]), 0.0f);
+        }
+    });
+
+    return forces;
+}
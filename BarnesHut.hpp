@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Octree.hpp"
+#include "ThreadPool.hpp"
+
+glm::vec3 calc_acceleration_barnes_hut(const Octree& tree,
+                                       const glm::vec4* positions,
+                                       const float* masses,
+                                       glm::vec3 position,
+                                       float theta,
+                                       std::vector<uint32_t>& stack);
+
+std::vector<glm::vec4> calc_forces_barnes_hut(const Octree& tree,
+                                              const std::vector<glm::vec4>& positions,
+                                              const std::vector<float>& masses,
+                                              size_t bodies_count,
+                                              float theta,
+                                              float G,
+                                              ThreadPool& pool);
@@ -1,31 +1,125 @@
 #include "Bodies.hpp"
 
 #include <glm/gtx/norm.hpp>
+#include <algorithm>
+#include <stdexcept>
 
 float Body::mass_to_radius(float val) {
     return std::pow(val/50.0f, 0.4f)/100.0f;
 }
 
-bool Body::operator==(const Body &that) const {
-    return &position == &that.position;
-}
-
-bool Body::operator!=(const Body &that) const {
-    return !(*this == that);
-}
-
-void Bodies::add(glm::vec4 p, glm::vec4 v, float m) {
+BodyId Bodies::add(glm::vec4 p, glm::vec4 v, float m) {
     if(count == positions.size()) {
         positions.push_back({});
         velocities.push_back({});
         masses.push_back({});
         radii.push_back({});
+        dead.push_back(0);
+        ids.push_back({});
+    }
+
+    BodyId id;
+    if(free_ids.empty()) {
+        id.index = uint32_t(id_slots.size());
+        id_slots.push_back(0);
+        id_generations.push_back(0);
+    } else {
+        id.index = free_ids.back();
+        free_ids.pop_back();
     }
+    id.generation = id_generations[id.index];
+    id_slots[id.index] = uint32_t(count);
+    ids[count] = id;
+
     auto last = get(count++);
     last.position = p;
     last.velocity = v;
     last.mass = m;
     update(last);
+    return id;
+}
+
+void Bodies::reserve(size_t capacity) {
+    positions.reserve(capacity);
+    velocities.reserve(capacity);
+    masses.reserve(capacity);
+    radii.reserve(capacity);
+    dead.reserve(capacity);
+    ids.reserve(capacity);
+    id_slots.reserve(capacity);
+    id_generations.reserve(capacity);
+}
+
+// makes room for added bodies after the live ones and gives them ids, the
+// free ones first in the order add() would take them
+size_t Bodies::grow(size_t added, ThreadPool& pool) {
+    auto first = count;
+    count += added;
+    if(positions.size() < count) {
+        positions.resize(count);
+        velocities.resize(count);
+        masses.resize(count);
+        radii.resize(count);
+        dead.resize(count, 0);
+        ids.resize(count);
+    }
+
+    auto reused = std::min(added, free_ids.size());
+    for(size_t k = 0; k < reused; ++k) {
+        auto index = free_ids.back();
+        free_ids.pop_back();
+        ids[first + k] = {index, id_generations[index]};
+        id_slots[index] = uint32_t(first + k);
+    }
+    auto fresh_base = id_slots.size();
+    auto fresh = added - reused;
+    id_slots.resize(fresh_base + fresh);
+    id_generations.resize(fresh_base + fresh, 0);
+    pool.parallel_for(0, fresh, [&](size_t begin, size_t end) {
+        for(auto k = begin; k < end; ++k) {
+            auto slot = first + reused + k;
+            ids[slot] = {uint32_t(fresh_base + k), 0};
+            id_slots[fresh_base + k] = uint32_t(slot);
+        }
+    });
+    return first;
+}
+
+void Bodies::update_radii(size_t first, ThreadPool& pool) {
+    worker_radius_max.assign(pool.size(), radius_max);
+    pool.parallel_for(first, count, [&](size_t begin, size_t end, size_t worker) {
+        for(auto id = begin; id < end; ++id) {
+            radii[id] = Body::mass_to_radius(masses[id]);
+            worker_radius_max[worker] = std::max(worker_radius_max[worker], radii[id]);
+        }
+    });
+    radius_max = *std::max_element(worker_radius_max.begin(), worker_radius_max.end());
+}
+
+void Bodies::assign(std::span<const glm::vec4> new_positions,
+                    std::span<const glm::vec4> new_velocities,
+                    std::span<const float> new_masses,
+                    std::span<const float> new_radii) {
+    if(new_velocities.size() != new_positions.size()
+       || new_masses.size() != new_positions.size()
+       || new_radii.size() != new_positions.size())
+        throw std::runtime_error("Bodies::assign: arrays of different sizes");
+    count = new_positions.size();
+    positions.assign(new_positions.begin(), new_positions.end());
+    velocities.assign(new_velocities.begin(), new_velocities.end());
+    masses.assign(new_masses.begin(), new_masses.end());
+    radii.assign(new_radii.begin(), new_radii.end());
+    dead.assign(count, 0);
+
+    ids.resize(count);
+    id_slots.resize(count);
+    id_generations.assign(count, 0);
+    free_ids.clear();
+    for(size_t slot = 0; slot < count; ++slot) {
+        ids[slot] = {uint32_t(slot), 0};
+        id_slots[slot] = uint32_t(slot);
+    }
+    radius_max = count ? *std::max_element(radii.begin(), radii.end()) : 0.0f;
 }
 
 Body Bodies::get(size_t id) {
@@ -37,23 +131,143 @@ Body Bodies::get(size_t id) {
     };
 }
 
+BodyId Bodies::get_id(size_t slot) const {
+    return ids[slot];
+}
+
+const std::vector<BodyId>& Bodies::get_ids() const {
+    return ids;
+}
+
+bool Bodies::contains(BodyId id) const {
+    return id.index < id_generations.size()
+        && id_generations[id.index] == id.generation
+        && id_slots[id.index] != BodyId::invalid;
+}
+
+size_t Bodies::get_slot(BodyId id) const {
+    return id_slots[id.index];
+}
+
 void Bodies::update(Body b) {
     b.radius = Body::mass_to_radius(b.mass);
-    radius_max = std::max(0.0f, b.radius);
+    radius_max = std::max(radius_max, b.radius);
 }
 
-void Bodies::remove(Body b) {
-    auto last = get(--count);
-    if(last != b) {
-        b.position = last.position;
-        b.velocity = last.velocity;
-        b.mass = last.mass;
-        b.radius = last.radius;
-    }
-    last.position = glm::vec4{0.0f};
-    last.velocity = glm::vec4{0.0f};
-    last.mass = 0.0f;
-    last.radius = 0.0f;
+void Bodies::mark_dead(size_t id) {
+    dead[id] = 1;
+}
+
+bool Bodies::is_dead(size_t id) const {
+    return dead[id];
+}
+
+size_t Bodies::compact(ThreadPool& pool, CompactOrder order) {
+    auto dead_count = release_dead_ids(pool);
+    if(dead_count == 0)
+        return 0;
+    auto kept = order == CompactOrder::Stable ? compact_stable(pool) : compact_fill_holes(dead_count, pool);
+    clear_tail(kept, pool);
+    count = kept;
+    return dead_count;
+}
+
+size_t Bodies::release_dead_ids(ThreadPool& pool) {
+    // released in slot order, so ids are handed out again deterministically
+    auto base = free_ids.size();
+    free_ids.resize(base + count);
+    auto dead_count = parallel_exclusive_scan(pool, count,
+        [&](size_t slot) { return size_t(dead[slot]); },
+        [&](size_t slot, size_t k) {
+            if(!dead[slot])
+                return;
+            auto id = ids[slot];
+            ++id_generations[id.index];
+            id_slots[id.index] = BodyId::invalid;
+            free_ids[base + k] = id.index;
+        });
+    free_ids.resize(base + dead_count);
+    return dead_count;
+}
+
+size_t Bodies::compact_stable(ThreadPool& pool) {
+    auto capacity = positions.size();
+    spare_positions.resize(capacity);
+    spare_velocities.resize(capacity);
+    spare_masses.resize(capacity);
+    spare_radii.resize(capacity);
+    spare_ids.resize(capacity);
+
+    auto kept = parallel_exclusive_scan(pool, count,
+        [&](size_t id) { return size_t(!dead[id]); },
+        [&](size_t id, size_t slot) {
+            if(dead[id])
+                return;
+            spare_positions[slot] = positions[id];
+            spare_velocities[slot] = velocities[id];
+            spare_masses[slot] = masses[id];
+            spare_radii[slot] = radii[id];
+            spare_ids[slot] = ids[id];
+            id_slots[ids[id].index] = uint32_t(slot);
+        });
+
+    positions.swap(spare_positions);
+    velocities.swap(spare_velocities);
+    masses.swap(spare_masses);
+    radii.swap(spare_radii);
+    ids.swap(spare_ids);
+    return kept;
+}
+
+size_t Bodies::compact_fill_holes(size_t dead_count, ThreadPool& pool) {
+    auto kept = count - dead_count;
+
+    // the k-th dead body below kept is replaced by the k-th live one above it
+    holes.resize(dead_count);
+    movers.resize(dead_count);
+    auto holes_count = parallel_exclusive_scan(pool, kept,
+        [&](size_t id) { return size_t(dead[id]); },
+        [&](size_t id, size_t slot) {
+            if(dead[id])
+                holes[slot] = uint32_t(id);
+        });
+    parallel_exclusive_scan(pool, count - kept,
+        [&](size_t k) { return size_t(!dead[kept + k]); },
+        [&](size_t k, size_t slot) {
+            if(!dead[kept + k])
+                movers[slot] = uint32_t(kept + k);
+        });
+    holes.resize(holes_count);
+
+    pool.parallel_for(0, holes.size(), [&](size_t begin, size_t end) {
+        for(auto k = begin; k < end; ++k) {
+            positions[holes[k]] = positions[movers[k]];
+            velocities[holes[k]] = velocities[movers[k]];
+            masses[holes[k]] = masses[movers[k]];
+            radii[holes[k]] = radii[movers[k]];
+            ids[holes[k]] = ids[movers[k]];
+            id_slots[ids[holes[k]].index] = holes[k];
+        }
+    });
+    return kept;
+}
+
+void Bodies::clear_tail(size_t kept, ThreadPool& pool) {
+    worker_radius_max.assign(pool.size(), 0.0f);
+    pool.parallel_for(0, positions.size(), [&](size_t begin, size_t end, size_t worker) {
+        for(auto id = begin; id < end; ++id) {
+            dead[id] = 0;
+            if(id >= kept) {
+                positions[id] = glm::vec4{0.0f};
+                velocities[id] = glm::vec4{0.0f};
+                masses[id] = 0.0f;
+                radii[id] = 0.0f;
+                ids[id] = BodyId{};
+            }
+            worker_radius_max[worker] = std::max(worker_radius_max[worker], radii[id]);
+        }
+    });
+    radius_max = *std::max_element(worker_radius_max.begin(), worker_radius_max.end());
 }
 
 size_t Bodies::get_count() const {
@@ -1,22 +1,50 @@
 #pragma once
 #include <vector>
+#include <span>
 #include <glm/glm.hpp>
 #include <ranges>
 
+#include "ThreadPool.hpp"
+
 struct Body {
     static float mass_to_radius(float val);
     glm::vec4 &position;
     glm::vec4 &velocity;
     float &mass;
     float &radius;
-    bool operator==(const Body &that) const;
-    bool operator!=(const Body &that) const;
 };
 
-template<> struct std::hash<Body> {
-    size_t operator()(const Body& b) const { return (size_t)&b.position; }
+// Stable handle of a body. The slot a body lives in changes when Bodies is
+// compacted, its id does not. A removed body's id index is reused with the
+// next generation, so stale handles never alias a new body.
+struct BodyId {
+    static constexpr uint32_t invalid = ~uint32_t(0);
+    uint32_t index{invalid};
+    uint32_t generation{0};
+    bool operator==(const BodyId &that) const = default;
+};
+
+template<> struct std::hash<BodyId> {
+    size_t operator()(const BodyId& id) const { return (size_t(id.generation) << 32) | id.index; }
 };
 
+// a body to append, its radius follows from the mass
+struct BodyState {
+    glm::vec4 position;
+    glm::vec4 velocity;
+    float mass;
+};
+
+enum class CompactOrder {
+    // survivors keep their relative order, e.g. a spatial sort from earlier
+    Stable,
+    // survivors from the tail are moved into the holes, fewer bodies move
+    FillHoles
+};
+
+// Bodies are removed in two steps: mark_dead only flags a body, so Body
+// references and indices taken during a step stay valid, and compact drops
+// every flagged body in one parallel pass.
 class Bodies {
     std::vector<glm::vec4> positions;
     std::vector<glm::vec4> velocities;
@@ -24,6 +52,28 @@ class Bodies {
     std::vector<float> radii;
     size_t count{0};
     float radius_max = 0.0f;
+    std::vector<uint8_t> dead;
+
+    std::vector<BodyId> ids;
+    std::vector<uint32_t> id_slots;
+    std::vector<uint32_t> id_generations;
+    std::vector<uint32_t> free_ids;
+
+    std::vector<glm::vec4> spare_positions;
+    std::vector<glm::vec4> spare_velocities;
+    std::vector<float> spare_masses;
+    std::vector<float> spare_radii;
+    std::vector<BodyId> spare_ids;
+    std::vector<float> worker_radius_max;
+    std::vector<uint32_t> holes;
+    std::vector<uint32_t> movers;
+
+    size_t grow(size_t added, ThreadPool& pool);
+    void update_radii(size_t first, ThreadPool& pool);
+    size_t release_dead_ids(ThreadPool& pool);
+    size_t compact_stable(ThreadPool& pool);
+    size_t compact_fill_holes(size_t dead_count, ThreadPool& pool);
+    void clear_tail(size_t kept, ThreadPool& pool);
 public:
     auto view() {
         auto make_body = [](auto& p, auto& v, auto& m, auto& r) {
@@ -38,10 +88,44 @@ public:
                | std::views::take(count);
     }
 
-    void add(glm::vec4 p, glm::vec4 v, float m);
+    BodyId add(glm::vec4 p, glm::vec4 v, float m);
+    void reserve(size_t capacity);
+    // appends added bodies in parallel, state(k) gives the k-th new one. Ids
+    // are handed out in slot order like add() does, so the result does not
+    // depend on the thread count.
+    template<typename F>
+    void append(size_t added, ThreadPool& pool, F&& state) {
+        auto first = grow(added, pool);
+        pool.parallel_for(0, added, [&](size_t begin, size_t end) {
+            for(auto k = begin; k < end; ++k) {
+                BodyState s = state(k);
+                positions[first + k] = s.position;
+                velocities[first + k] = s.velocity;
+                masses[first + k] = s.mass;
+            }
+        });
+        update_radii(first, pool);
+    }
+    // replaces all bodies with copies of the arrays, radii are taken as they
+    // are. Ids restart at {slot, 0}. Throws std::runtime_error unless all
+    // arrays have the same size.
+    void assign(std::span<const glm::vec4> new_positions,
+                std::span<const glm::vec4> new_velocities,
+                std::span<const float> new_masses,
+                std::span<const float> new_radii);
     Body get(size_t id);
+    BodyId get_id(size_t slot) const;
+    // ids by slot, the first get_count() entries are live
+    const std::vector<BodyId>& get_ids() const;
+    bool contains(BodyId id) const;
+    // slot of a live body, valid until the next compact
+    size_t get_slot(BodyId id) const;
     void update(Body b);
-    void remove(Body b);
+    // safe to call concurrently for different bodies
+    void mark_dead(size_t id);
+    bool is_dead(size_t id) const;
+    // returns the number of bodies removed
+    size_t compact(ThreadPool& pool, CompactOrder order = CompactOrder::Stable);
     size_t get_count() const;
     float get_radius_max() const;
     const std::vector<glm::vec4>& get_positions() const;
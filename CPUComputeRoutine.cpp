@@ -1,15 +1,34 @@
 #include "CPUComputeRoutine.hpp"
+#include "Profiler.hpp"
 
-CPUComputeRoutine::CPUComputeRoutine(Bodies &bodies, ArrayBufferObject &positions_out, ArrayBufferObject &radii_out, float G)
+#include <stdexcept>
+
+CPUComputeRoutine::CPUComputeRoutine(Bodies &bodies,
+                                     float G,
+                                     const GravitySolverConfig& gravity_config,
+                                     const IntegratorConfig& integrator_config,
+                                     ThreadPool& pool)
     : bodies(bodies)
-    , pos_out(positions_out)
-    , rad_out(radii_out)
-    , G(G) {}
+    , G(G)
+    , gravity_config(gravity_config)
+    , integrator(integrator_config)
+    , pool(pool) {
+    if(!solver_supports_scheme(gravity_config.solver, integrator_config.scheme))
+        throw std::runtime_error(std::string("the ") + integration_scheme_name(integrator_config.scheme)
+                                 + " integrator cannot use the " + gravity_solver_name(gravity_config.solver) + " solver");
+}
 
-void CPUComputeRoutine::compute() {
-    compute_collisions_cpu(bodies);
-    rad_out.bind().update(bodies.get_radii());
+Integrator* CPUComputeRoutine::get_integrator() {
+    return &integrator;
+}
 
-    compute_gravity_cpu_parallel(bodies, G, 8);
-    pos_out.bind().update(bodies.get_positions());
+void CPUComputeRoutine::reload_bodies() {
+    integrator.invalidate();
+}
+
+void CPUComputeRoutine::compute() {
+    if(compute_collisions_cpu(bodies, collision_buffers, pool))
+        integrator.invalidate();
+    PROFILE_SCOPE("gravity");
+    compute_gravity_cpu(bodies, G, gravity_config, integrator, pool);
 }
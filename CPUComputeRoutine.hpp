@@ -1,17 +1,25 @@
 #pragma once
 
 #include "ComputeCPU.hpp"
-#include "gl_context/VertexArrayObject.hpp"
+#include "ComputeRoutine.hpp"
 
-struct CPUComputeRoutine {
+// Collisions and gravity on the CPU. Touches no GL state, so it can run on
+// any thread; the caller uploads the results.
+struct CPUComputeRoutine : ComputeRoutine {
     Bodies& bodies;
-    ArrayBufferObject &pos_out, &rad_out;
     float G;
+    GravitySolverConfig gravity_config;
+    Integrator integrator;
+    CollisionBuffers collision_buffers;
+    ThreadPool& pool;
 public:
     CPUComputeRoutine(Bodies& bodies,
-                      ArrayBufferObject &positions_out,
-                      ArrayBufferObject &radii_out,
-                      float G);
+                      float G,
+                      const GravitySolverConfig& gravity_config,
+                      const IntegratorConfig& integrator_config,
+                      ThreadPool& pool);
 
-    void compute();
+    void compute() override;
+    Integrator* get_integrator() override;
+    void reload_bodies() override;
 };
@@ -1,31 +1,109 @@
 #include "CPUGPUComputeRoutine.hpp"
 
-CPUGPUComputeRoutine::CPUGPUComputeRoutine(Bodies &bodies, ArrayBufferObject &positions_out, ArrayBufferObject &radii_out, float G)
+#include <algorithm>
+#include <stdexcept>
+
+#include "Profiler.hpp"
+
+bool CPUGPUComputeRoutine::is_supported() {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return major * 10 + minor >= 45;
+}
+
+CPUGPUComputeRoutine::CPUGPUComputeRoutine(Bodies &bodies,
+                                           ArrayBufferObject &positions_out,
+                                           ArrayBufferObject &radii_out,
+                                           float G,
+                                           const IntegratorConfig& integrator_config,
+                                           ThreadPool& pool,
+                                           GravityKernelConfig kernel_config)
     : bodies(bodies)
     , vbo_positions_out(positions_out)
     , rad_out(radii_out)
-    , G(G) {
-    vbo_position_calc_in.bind().init<glm::vec4>(bodies.get_count());
-    vbo_velocities_calc_in.bind().init<glm::vec4>(bodies.get_count());
-    vbo_mass_calc_in.bind().init<float>(bodies.get_count());
-    vbo_velocities_calc_out.bind().init<glm::vec4>(bodies.get_count());
-    gravity_compute.set_vbos(vbo_position_calc_in,
-                             vbo_velocities_calc_in,
-                             vbo_mass_calc_in,
-                             vbo_positions_out,
-                             vbo_velocities_calc_out);
+    , G(G)
+    , integrator_config(integrator_config)
+    , pool(pool)
+    , gravity_compute(kernel_config) {
+    if(!is_supported())
+        throw std::runtime_error("the cpu-gpu routine needs OpenGL 4.5");
+    if(integrator_config.block_levels > 0)
+        throw std::runtime_error("the cpu-gpu routine cannot take block timesteps");
+
+    for(size_t side = 0; side < 2; ++side) {
+        vbo_positions[side].bind().init<glm::vec4>(bodies.get_count());
+        vbo_velocities[side].bind().init<glm::vec4>(bodies.get_count());
+    }
+    vbo_masses.bind().init<float>(bodies.get_count());
+    gravity_compute.reserve(bodies.get_count());
+    upload_state();
 }
 
-void CPUGPUComputeRoutine::compute() {
-    compute_collisions_cpu(bodies);
-    rad_out.bind().update(bodies.get_radii());
+// after a merge, the host has the only current copy
+void CPUGPUComputeRoutine::upload_state() {
+    PROFILE_SCOPE("state_upload");
+    vbo_positions[current].bind().update(bodies.get_positions(), bodies.get_count());
+    vbo_velocities[current].bind().update(bodies.get_velocities(), bodies.get_count());
+    vbo_masses.bind().update(bodies.get_masses(), bodies.get_count());
+    rad_out.bind().update(bodies.get_radii(), bodies.get_count());
+    copy_buffer(vbo_positions[current], vbo_positions_out, bodies.get_count() * sizeof(glm::vec4));
+    derivatives_valid = false;
+}
 
-    vbo_position_calc_in.bind().update(bodies.get_positions(), bodies.get_count());
-    vbo_velocities_calc_in.bind().update(bodies.get_velocities(), bodies.get_count());
-    vbo_mass_calc_in.bind().update(bodies.get_masses(), bodies.get_count());
+void CPUGPUComputeRoutine::read_positions() {
+    if(!positions_readback.is_pending())
+        positions_readback.request(vbo_positions[current], bodies.get_count() * sizeof(glm::vec4));
+    PROFILE_SCOPE("position_readback");
+    auto data = static_cast<const glm::vec4*>(positions_readback.wait());
+    std::copy(data, data + bodies.get_count(), bodies.get_positions().begin());
+}
+
+void CPUGPUComputeRoutine::read_velocities() {
+    velocities_readback.request(vbo_velocities[current], bodies.get_count() * sizeof(glm::vec4));
+    PROFILE_SCOPE("velocity_readback");
+    auto data = static_cast<const glm::vec4*>(velocities_readback.wait());
+    std::copy(data, data + bodies.get_count(), bodies.get_velocities().begin());
+}
 
-    gravity_compute.calculate(bodies.get_count(), G);
+void CPUGPUComputeRoutine::compute() {
+    auto collision_step = step++ % std::max<size_t>(collision_interval, 1) == 0;
+    if(collision_step) {
+        read_positions();
+        if(detect_collisions_cpu(bodies, collision_buffers, pool)) {
+            read_velocities();
+            resolve_collisions_cpu(bodies, collision_buffers, pool);
+            upload_state();
+        }
+    }
+    {
+        // only the submission, the GPU time ends up in the next readback
+        PROFILE_SCOPE("gravity");
+        auto next = current ^ 1;
+        gravity_compute.set_vbos(vbo_positions[current],
+                                 vbo_velocities[current],
+                                 vbo_masses,
+                                 vbo_positions[next],
+                                 vbo_velocities[next]);
+        gravity_compute.calculate(bodies.get_count(), G, integrator_config, derivatives_valid);
+        derivatives_valid = true;
+        current = next;
+    }
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    copy_buffer(vbo_positions[current], vbo_positions_out, bodies.get_count() * sizeof(glm::vec4));
+    // started now so the copy overlaps with whatever runs before the next
+    // collision phase
+    if(step % std::max<size_t>(collision_interval, 1) == 0)
+        positions_readback.request(vbo_positions[current], bodies.get_count() * sizeof(glm::vec4));
+}
+
+void CPUGPUComputeRoutine::sync_bodies() {
+    read_positions();
+    read_velocities();
+}
 
-    vbo_positions_out.bind().download(bodies.get_positions(), bodies.get_count());
-    vbo_velocities_calc_out.bind().download(bodies.get_velocities(), bodies.get_count());
+void CPUGPUComputeRoutine::reload_bodies() {
+    if(positions_readback.is_pending())
+        positions_readback.wait();
+    upload_state();
 }
@@ -1,25 +1,59 @@
 #pragma once
 
+#include <array>
+
 #include "ComputeGPU.hpp"
 #include "ComputeCPU.hpp"
+#include "ComputeRoutine.hpp"
 
-struct CPUGPUComputeRoutine {
+// Gravity on the GPU, collisions on the CPU. Positions and velocities stay
+// on the device in ping-pong buffers between steps. Only positions come back,
+// through a fenced readback, for collision detection. Velocities are read
+// back, and the whole state re-uploaded, only when bodies merge.
+// So between merges the host velocities are those of the last merge or
+// upload, and the host positions lag the device by a step. Anything that
+// reads bodies for more than collisions (a snapshot, a switch to another
+// routine) calls sync_bodies() first. The kernels take Euler, leapfrog and
+// Hermite steps, but no block timesteps.
+struct CPUGPUComputeRoutine : ComputeRoutine {
     Bodies& bodies;
     ArrayBufferObject &vbo_positions_out, &rad_out;
     float G;
+    IntegratorConfig integrator_config;
+    bool derivatives_valid = false;
+    // steps between collision phases, the steps in between need no readback
+    size_t collision_interval = 1;
+    CollisionBuffers collision_buffers;
+    ThreadPool& pool;
 
-    ArrayBufferObject
-        vbo_position_calc_in,
-        vbo_velocities_calc_in,
-        vbo_mass_calc_in,
-        vbo_velocities_calc_out;
+    std::array<ArrayBufferObject, 2> vbo_positions, vbo_velocities;
+    ArrayBufferObject vbo_masses;
+    // ping-pong side holding the current state
+    size_t current = 0;
+    size_t step = 0;
+    FencedReadback positions_readback;
+    FencedReadback velocities_readback;
 
     GravityComputeGPU gravity_compute;
 
+    void upload_state();
+    void read_positions();
+    void read_velocities();
+
+    // needs OpenGL 4.5 for the buffer copies and the fenced readback
+    static bool is_supported();
+
     CPUGPUComputeRoutine(Bodies& bodies,
                          ArrayBufferObject &positions_out,
                          ArrayBufferObject  &radii_out,
-                         float G);
+                         float G,
+                         const IntegratorConfig& integrator_config,
+                         ThreadPool& pool,
+                         GravityKernelConfig kernel_config = {});
 
-    void compute();
+    void compute() override;
+    // blocks until host positions and velocities match the device
+    void sync_bodies() override;
+    // uploads the host state again, dropping any readback in flight
+    void reload_bodies() override;
 };
@@ -0,0 +1,43 @@
+#include "ChunkedGPUComputeRoutine.hpp"
+
+#include <stdexcept>
+
+#include "Profiler.hpp"
+
+ChunkedGPUComputeRoutine::ChunkedGPUComputeRoutine(Bodies &bodies,
+                                                   ArrayBufferObject &positions_out,
+                                                   ArrayBufferObject &radii_out,
+                                                   float G,
+                                                   const IntegratorConfig& integrator_config,
+                                                   ThreadPool& pool,
+                                                   ChunkedGravityConfig chunked_config)
+    : bodies(bodies)
+    , vbo_positions_out(positions_out)
+    , rad_out(radii_out)
+    , G(G)
+    , integrator_config(integrator_config)
+    , pool(pool)
+    , gravity_compute(chunked_config) {
+    if(integrator_config.scheme != IntegrationScheme::Euler)
+        throw std::runtime_error(std::string("the chunked-gpu routine cannot take ")
+                                 + integration_scheme_name(integrator_config.scheme) + " steps");
+}
+
+void ChunkedGPUComputeRoutine::compute() {
+    compute_collisions_cpu(bodies, collision_buffers, pool);
+    {
+        PROFILE_SCOPE("radius_upload");
+        rad_out.bind().update(bodies.get_radii(), bodies.get_count());
+    }
+    {
+        PROFILE_SCOPE("input_upload");
+        gravity_compute.upload(bodies);
+    }
+    {
+        PROFILE_SCOPE("gravity");
+        gravity_compute.step(bodies.get_count(), G, integrator_config.dt);
+    }
+    PROFILE_SCOPE("download");
+    gravity_compute.download(bodies);
+    gravity_compute.copy_positions_out(vbo_positions_out, bodies.get_count());
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "ComputeCPU.hpp"
+#include "ComputeRoutine.hpp"
+#include "GLComputeShaders.hpp"
+
+// Gravity through the chunked pairwise pipeline, for body counts whose force
+// matrix is too large for one dispatch. The pipeline only takes Euler steps,
+// other schemes are rejected. The host keeps the state: every step uploads
+// it, and downloads it after the GPU step for the collisions.
+struct ChunkedGPUComputeRoutine : ComputeRoutine {
+    Bodies& bodies;
+    ArrayBufferObject &vbo_positions_out, &rad_out;
+    float G;
+    IntegratorConfig integrator_config;
+    CollisionBuffers collision_buffers;
+    ThreadPool& pool;
+    ChunkedGravityGPU gravity_compute;
+
+    ChunkedGPUComputeRoutine(Bodies& bodies,
+                             ArrayBufferObject &positions_out,
+                             ArrayBufferObject &radii_out,
+                             float G,
+                             const IntegratorConfig& integrator_config,
+                             ThreadPool& pool,
+                             ChunkedGravityConfig chunked_config = {});
+
+    void compute() override;
+};
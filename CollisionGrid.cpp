@@ -0,0 +1,184 @@
+#include "CollisionGrid.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <numeric>
+
+namespace {
+constexpr size_t chunk_size = 2048;
+
+// the forward half of the 26 neighbours as rows of three cells, x from -1 to 1
+const glm::ivec3 forward_rows[4] = {
+    {-1, 1, 0}, {-1, -1, 1}, {-1, 0, 1}, {-1, 1, 1}
+};
+
+glm::ivec3 cell_of(glm::vec4 position, float cell_size) {
+    // far away bodies share the outermost cells, which only adds candidates
+    auto cell = glm::clamp(glm::floor(glm::vec3(position) / cell_size),
+                           glm::vec3(-(1 << 30)),
+                           glm::vec3(1 << 30));
+    return glm::ivec3(cell);
+}
+}
+
+uint32_t CollisionGrid::bucket_of(glm::ivec3 cell) const {
+    // cells span up to 2^31 + 2 per axis, past what int holds
+    auto dx = uint64_t(int64_t(cell.x) - cell_min.x);
+    auto dy = uint64_t(int64_t(cell.y) - cell_min.y);
+    auto dz = uint64_t(int64_t(cell.z) - cell_min.z);
+    return uint32_t((dx + dy * stride_y + dz * stride_z) & bucket_mask);
+}
+
+template<typename F>
+void CollisionGrid::for_each_candidate(size_t slot, F&& fn) const {
+    auto cell = sorted_cells[slot];
+    auto sphere = sorted_spheres[slot];
+    auto visit = [&](size_t k) {
+        auto other = sorted_spheres[k];
+        auto diff = glm::vec3(other) - glm::vec3(sphere);
+        auto rad_sum = other.w + sphere.w;
+        if(glm::dot(diff, diff) < rad_sum * rad_sum)
+            fn(sorted[k]);
+    };
+    // cells of a row sit in consecutive buckets unless the row wraps around the table
+    auto scan_row = [&](glm::ivec3 first, int width, size_t from) {
+        auto bucket = bucket_of(first);
+        if(bucket + width - 1 <= bucket_mask) {
+            auto occupied_row = false;
+            for(int x = 0; x < width; ++x)
+                occupied_row |= occupied[(bucket + x) / 64] >> ((bucket + x) % 64) & 1;
+            if(!occupied_row)
+                return;
+            for(auto k = std::max<size_t>(from, bucket_begin[bucket]); k < bucket_begin[bucket + width]; ++k) {
+                auto other = sorted_cells[k];
+                if(other.y == first.y && other.z == first.z
+                   && uint64_t(int64_t(other.x) - first.x) < uint64_t(width))
+                    visit(k);
+            }
+            return;
+        }
+        for(int x = 0; x < width; ++x) {
+            auto nb = bucket_of(first + glm::ivec3(x, 0, 0));
+            for(auto k = std::max<size_t>(x == 0 ? from : 0, bucket_begin[nb]); k < bucket_begin[nb + 1]; ++k)
+                if(sorted_cells[k] == first + glm::ivec3(x, 0, 0))
+                    visit(k);
+        }
+    };
+    // own cell after this body, then the next cell of the row
+    scan_row(cell, 2, slot + 1);
+    for(auto row : forward_rows)
+        scan_row(cell + row, 3, 0);
+}
+
+const std::vector<index_pair>& CollisionGrid::build(const std::vector<glm::vec4>& positions,
+                                                    const std::vector<float>& radii,
+                                                    size_t bodies_count,
+                                                    float radius_max,
+                                                    ThreadPool& pool) {
+    pairs.clear();
+    if(bodies_count < 2 || radius_max <= 0.0f)
+        return pairs;
+
+    cell_size = 2.0f * radius_max;
+    auto buckets_count = std::bit_ceil(std::max<size_t>(bodies_count * 2, 64));
+    bucket_mask = uint32_t(buckets_count - 1);
+
+    cells.resize(bodies_count);
+    sorted_cells.resize(bodies_count);
+    sorted_spheres.resize(bodies_count);
+    buckets.resize(bodies_count);
+    sorted.resize(bodies_count);
+    bucket_begin.assign(buckets_count + 1, 0);
+    bucket_cursor.resize(buckets_count);
+    occupied.assign(buckets_count / 64, 0);
+    worker_min.assign(pool.size(), glm::ivec3(1 << 30));
+    worker_max.assign(pool.size(), glm::ivec3(-(1 << 30)));
+    pool.parallel_for(0, bodies_count, [&](size_t begin, size_t end, size_t worker) {
+        for(auto i = begin; i < end; ++i) {
+            cells[i] = cell_of(positions[i], cell_size);
+            worker_min[worker] = glm::min(worker_min[worker], cells[i]);
+            worker_max[worker] = glm::max(worker_max[worker], cells[i]);
+        }
+    });
+    cell_min = worker_min[0];
+    auto cell_max = worker_max[0];
+    for(size_t w = 1; w < pool.size(); ++w) {
+        cell_min = glm::min(cell_min, worker_min[w]);
+        cell_max = glm::max(cell_max, worker_max[w]);
+    }
+    // one spare cell per axis keeps +1 neighbours from wrapping onto the next row
+    cell_min -= glm::ivec3(1);
+    // the strides only feed the bucket hash, so their product may wrap
+    auto span = [&](int axis) { return uint64_t(int64_t(cell_max[axis]) - cell_min[axis] + 2); };
+    stride_y = span(0);
+    stride_z = stride_y * span(1);
+
+    pool.parallel_for(0, bodies_count, [&](size_t begin, size_t end) {
+        for(auto i = begin; i < end; ++i) {
+            buckets[i] = bucket_of(cells[i]);
+            std::atomic_ref(bucket_begin[buckets[i] + 1]).fetch_add(1, std::memory_order_relaxed);
+            std::atomic_ref(occupied[buckets[i] / 64]).fetch_or(uint64_t(1) << (buckets[i] % 64),
+                                                                std::memory_order_relaxed);
+        }
+    });
+
+    std::inclusive_scan(bucket_begin.begin(), bucket_begin.end(), bucket_begin.begin());
+    std::copy(bucket_begin.begin(), bucket_begin.end() - 1, bucket_cursor.begin());
+
+    pool.parallel_for(0, bodies_count, [&](size_t begin, size_t end) {
+        for(auto i = begin; i < end; ++i) {
+            auto slot = std::atomic_ref(bucket_cursor[buckets[i]]).fetch_add(1, std::memory_order_relaxed);
+            sorted[slot] = uint32_t(i);
+        }
+    });
+
+    // scatter order depends on scheduling, buckets hold a couple of bodies at most
+    pool.parallel_for(0, buckets_count, [&](size_t begin, size_t end) {
+        for(auto b = begin; b < end; ++b) {
+            auto first = sorted.begin() + bucket_begin[b];
+            auto last = sorted.begin() + bucket_begin[b + 1];
+            if(last - first > 1)
+                std::sort(first, last);
+            for(auto it = first; it != last; ++it) {
+                sorted_cells[it - sorted.begin()] = cells[*it];
+                sorted_spheres[it - sorted.begin()] = glm::vec4(glm::vec3(positions[*it]), radii[*it]);
+            }
+        }
+    });
+
+    // fixed chunks keep the pair order independent of scheduling
+    auto chunks_count = (bodies_count + chunk_size - 1) / chunk_size;
+    if(chunk_pairs.size() < chunks_count)
+        chunk_pairs.resize(chunks_count);
+    pool.parallel_for(0, chunks_count, 1, [&](size_t begin, size_t end) {
+        for(auto chunk = begin; chunk < end; ++chunk) {
+            auto& out = chunk_pairs[chunk];
+            out.clear();
+            for(auto k = chunk * chunk_size; k < std::min(bodies_count, (chunk + 1) * chunk_size); ++k) {
+                auto body_id = sorted[k];
+                for_each_candidate(k, [&](uint32_t other) {
+                    out.push_back({std::min(body_id, other), std::max(body_id, other)});
+                });
+            }
+        }
+    });
+
+    chunk_begin.resize(chunks_count + 1);
+    chunk_begin[0] = 0;
+    for(size_t chunk = 0; chunk < chunks_count; ++chunk)
+        chunk_begin[chunk + 1] = chunk_begin[chunk] + chunk_pairs[chunk].size();
+    pairs.resize(chunk_begin[chunks_count]);
+
+    pool.parallel_for(0, chunks_count, 1, [&](size_t begin, size_t end) {
+        for(auto chunk = begin; chunk < end; ++chunk)
+            std::copy(chunk_pairs[chunk].begin(), chunk_pairs[chunk].end(), pairs.begin() + chunk_begin[chunk]);
+    });
+
+    return pairs;
+}
+
+const std::vector<index_pair>& CollisionGrid::get_pairs() const {
+    return pairs;
+}
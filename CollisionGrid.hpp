@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+
+using index_pair = std::pair<uint32_t, uint32_t>;
+
+// Uniform 3D grid broad phase. Cells are 2 * radius_max wide, so two
+// overlapping bodies always share a cell or sit in adjacent ones. Cells are
+// numbered row-major over the bounding box and wrapped into a power-of-two
+// table of buckets, body indices are counting-sorted by bucket. Every cell
+// is paired with itself and its 13 forward neighbours, bodies are matched
+// on their real cell coordinates, so wrapped cells never produce duplicate
+// pairs. Only pairs whose bounding spheres overlap are emitted. Buffers are
+// kept between calls and only grow.
+class CollisionGrid {
+    float cell_size{0.0f};
+    glm::ivec3 cell_min{0};
+    uint64_t stride_y{0};
+    uint64_t stride_z{0};
+    uint32_t bucket_mask{0};
+
+    std::vector<glm::ivec3> cells;
+    std::vector<glm::ivec3> sorted_cells;
+    std::vector<glm::vec4> sorted_spheres;
+    std::vector<uint32_t> buckets;
+    std::vector<uint32_t> bucket_begin;
+    std::vector<uint32_t> bucket_cursor;
+    std::vector<uint32_t> sorted;
+    std::vector<uint64_t> occupied;
+    std::vector<glm::ivec3> worker_min, worker_max;
+    std::vector<std::vector<index_pair>> chunk_pairs;
+    std::vector<size_t> chunk_begin;
+    std::vector<index_pair> pairs;
+
+    uint32_t bucket_of(glm::ivec3 cell) const;
+    template<typename F>
+    void for_each_candidate(size_t slot, F&& fn) const;
+public:
+    const std::vector<index_pair>& build(const std::vector<glm::vec4>& positions,
+                                         const std::vector<float>& radii,
+                                         size_t bodies_count,
+                                         float radius_max,
+                                         ThreadPool& pool);
+
+    const std::vector<index_pair>& get_pairs() const;
+};
@@ -1,35 +1,137 @@
 #include "ComputeCPU.hpp"
 #include "Utils.hpp"
 #include "ComputeCPUFunctions.hpp"
+#include "DirectSumSimd.hpp"
+#include "PairTiling.hpp"
+#include "BarnesHut.hpp"
+#include "FastMultipole.hpp"
+#include "Profiler.hpp"
 
-void compute_collisions_cpu(Bodies &bodies) {
-    auto candidates = get_collision_candidates(bodies.view(), 4.0f);
-    auto collisions = detect_collisions(candidates | std::views::all);
+const char* gravity_solver_name(GravitySolver solver) {
+    switch(solver) {
+    case GravitySolver::Direct: return "direct";
+    case GravitySolver::DirectSimd: return "simd";
+    case GravitySolver::BarnesHut: return "barnes-hut";
+    case GravitySolver::FastMultipole: return "fmm";
+    case GravitySolver::ParticleMesh: return "pm";
+    }
+    return "unknown";
+}
+
+bool parse_gravity_solver(const std::string& name, GravitySolver& solver) {
+    for(auto candidate : gravity_solvers) {
+        if(name == gravity_solver_name(candidate)) {
+            solver = candidate;
+            return true;
+        }
+    }
+    return false;
+}
 
-    auto deref = [](auto &ptr) -> auto& { return *ptr; };
-    auto [updated, removed] = resolve_collisions(collisions | std::views::transform(deref));
-    for(auto u : updated) {
-        bodies.update(u);
+bool solver_supports_scheme(GravitySolver solver, IntegrationScheme scheme) {
+    return scheme != IntegrationScheme::Hermite || solver == GravitySolver::Direct;
+}
+
+bool detect_collisions_cpu(Bodies &bodies, CollisionBuffers &buffers, ThreadPool &pool) {
+    {
+        PROFILE_SCOPE("collision_candidates");
+        buffers.grid.build(bodies.get_positions(),
+                           bodies.get_radii(),
+                           bodies.get_count(),
+                           bodies.get_radius_max(),
+                           pool);
     }
-    for(auto r : removed) {
-        bodies.remove(r);
+    {
+        PROFILE_SCOPE("collision_detection");
+        detect_collisions(bodies, buffers.grid.get_pairs(), buffers.sets, buffers.groups, pool);
     }
+    return buffers.groups.size() != 0;
+}
+
+size_t resolve_collisions_cpu(Bodies &bodies, CollisionBuffers &buffers, ThreadPool &pool) {
+    PROFILE_SCOPE("collision_resolution");
+    resolve_collisions(bodies, buffers.groups, pool);
+    return bodies.compact(pool);
+}
+
+size_t compute_collisions_cpu(Bodies &bodies, CollisionBuffers &buffers, ThreadPool &pool) {
+    if(!detect_collisions_cpu(bodies, buffers, pool))
+        return 0;
+    return resolve_collisions_cpu(bodies, buffers, pool);
+}
+
+std::vector<glm::vec4> calc_forces_cpu(Bodies &bodies, float G) {
+    return calc_forces(bodies.get_positions(), bodies.get_masses(), bodies.get_count(), G);
+}
+
+std::vector<glm::vec4> calc_forces_cpu_parallel(Bodies &bodies, float G, ThreadPool &pool) {
+    return calc_forces_tiled(bodies.get_positions(),
+                             bodies.get_masses(),
+                             bodies.get_count(),
+                             pool,
+                             G);
 }
 
-void compute_gravity_cpu(Bodies &bodies, float G) {
-    auto enum_bodies = bodies.view() | std::views::enumerate;
+std::vector<glm::vec4> calc_forces_cpu_simd(Bodies &bodies, float G, ThreadPool &pool) {
+    SplitBodies split;
+    split.load(bodies.get_positions(), bodies.get_masses(), bodies.get_count());
+    return calc_forces_simd(split, G, pool);
+}
 
-    UniquePairs pairs(enum_bodies);
-    auto forces = calc_forces(pairs, bodies.get_count(), G);
+std::vector<glm::vec4> calc_forces_cpu_barnes_hut(Bodies &bodies, float G, float theta, ThreadPool &pool) {
+    Octree tree;
+    tree.build(bodies.get_positions(), bodies.get_masses(), bodies.get_count());
+    return calc_forces_barnes_hut(tree,
+                                  bodies.get_positions(),
+                                  bodies.get_masses(),
+                                  bodies.get_count(),
+                                  theta,
+                                  G,
+                                  pool);
+}
 
-    apply_force(bodies.view(), forces | std::views::all);
+std::vector<glm::vec4> calc_forces_cpu_fmm(Bodies &bodies, float G, size_t order, float theta, ThreadPool &pool) {
+    FastMultipole fmm(order, theta);
+    return fmm.calc_forces(bodies.get_positions(),
+                           bodies.get_masses(),
+                           bodies.get_count(),
+                           G,
+                           pool);
 }
 
-void compute_gravity_cpu_parallel(Bodies &bodies, float G, size_t thread_count) {
-    auto enum_bodies = bodies.view() | std::views::enumerate;
+std::vector<glm::vec4> calc_forces_cpu_pm(Bodies &bodies,
+                                          float G,
+                                          size_t grid_size,
+                                          MassAssignment assignment,
+                                          ThreadPool &pool) {
+    ParticleMesh pm(grid_size, assignment);
+    return pm.calc_forces(bodies.get_positions(),
+                          bodies.get_masses(),
+                          bodies.get_count(),
+                          G,
+                          pool);
+}
 
-    UniquePairs pairs(enum_bodies);
-    auto forces = calc_forces(pairs, bodies.get_count(), thread_count, G);
+std::vector<glm::vec4> calc_forces_cpu(Bodies &bodies, float G, const GravitySolverConfig &config, ThreadPool &pool) {
+    switch(config.solver) {
+    case GravitySolver::Direct:
+        return calc_forces_cpu_parallel(bodies, G, pool);
+    case GravitySolver::DirectSimd:
+        return calc_forces_cpu_simd(bodies, G, pool);
+    case GravitySolver::BarnesHut:
+        return calc_forces_cpu_barnes_hut(bodies, G, config.theta, pool);
+    case GravitySolver::FastMultipole:
+        return calc_forces_cpu_fmm(bodies, G, config.fmm_order, config.theta, pool);
+    case GravitySolver::ParticleMesh:
+        return calc_forces_cpu_pm(bodies, G, config.pm_grid_size, config.pm_assignment, pool);
+    }
+    return {};
+}
 
-    apply_force(bodies.view(), forces | std::views::all);
+void compute_gravity_cpu(Bodies &bodies,
+                         float G,
+                         const GravitySolverConfig &config,
+                         Integrator &integrator,
+                         ThreadPool &pool) {
+    integrator.step(bodies, G, [&](Bodies &b) { return calc_forces_cpu(b, G, config, pool); }, pool);
 }
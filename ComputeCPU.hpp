@@ -1,9 +1,79 @@
 #pragma once
 
+#include <string>
+
 #include "Bodies.hpp"
+#include "CollisionGrid.hpp"
+#include "DisjointSet.hpp"
+#include "Integrator.hpp"
+#include "ParticleMesh.hpp"
+#include "ThreadPool.hpp"
+
+enum class GravitySolver {
+    Direct,
+    DirectSimd,
+    BarnesHut,
+    FastMultipole,
+    ParticleMesh
+};
+
+inline constexpr GravitySolver gravity_solvers[] = {
+    GravitySolver::Direct,
+    GravitySolver::DirectSimd,
+    GravitySolver::BarnesHut,
+    GravitySolver::FastMultipole,
+    GravitySolver::ParticleMesh
+};
+
+// direct | simd | barnes-hut | fmm | pm
+const char* gravity_solver_name(GravitySolver solver);
+bool parse_gravity_solver(const std::string& name, GravitySolver& solver);
+// Hermite evaluates forces and jerks with its own direct sum, so it only
+// pairs with the direct solver
+bool solver_supports_scheme(GravitySolver solver, IntegrationScheme scheme);
+
+struct GravitySolverConfig {
+    GravitySolver solver = GravitySolver::Direct;
+    float theta = 0.5f;
+    size_t fmm_order = 4;
+    size_t pm_grid_size = 64;
+    MassAssignment pm_assignment = MassAssignment::CIC;
+};
+
+struct CollisionBuffers {
+    CollisionGrid grid;
+    ConcurrentDisjointSet sets;
+    FlatGroups groups;
+};
+
+// returns the number of bodies merged away
+size_t compute_collisions_cpu(Bodies& bodies, CollisionBuffers& buffers, ThreadPool& pool);
+// the two halves of compute_collisions_cpu: detection only reads positions
+// and radii, resolution also needs current velocities and masses.
+// detect_collisions_cpu returns whether there is anything to resolve.
+bool detect_collisions_cpu(Bodies& bodies, CollisionBuffers& buffers, ThreadPool& pool);
+size_t resolve_collisions_cpu(Bodies& bodies, CollisionBuffers& buffers, ThreadPool& pool);
+
+std::vector<glm::vec4> calc_forces_cpu(Bodies& bodies, float G);
+
+std::vector<glm::vec4> calc_forces_cpu_parallel(Bodies& bodies, float G, ThreadPool& pool);
+
+std::vector<glm::vec4> calc_forces_cpu_simd(Bodies& bodies, float G, ThreadPool& pool);
+
+std::vector<glm::vec4> calc_forces_cpu_barnes_hut(Bodies& bodies, float G, float theta, ThreadPool& pool);
+
+std::vector<glm::vec4> calc_forces_cpu_fmm(Bodies& bodies, float G, size_t order, float theta, ThreadPool& pool);
 
-void compute_collisions_cpu(Bodies& bodies);
+std::vector<glm::vec4> calc_forces_cpu_pm(Bodies& bodies,
+                                          float G,
+                                          size_t grid_size,
+                                          MassAssignment assignment,
+                                          ThreadPool& pool);
 
-void compute_gravity_cpu(Bodies& bodies, float G);
+std::vector<glm::vec4> calc_forces_cpu(Bodies& bodies, float G, const GravitySolverConfig& config, ThreadPool& pool);
 
-void compute_gravity_cpu_parallel(Bodies& bodies, float G, size_t thread_count);
+void compute_gravity_cpu(Bodies& bodies,
+                         float G,
+                         const GravitySolverConfig& config,
+                         Integrator& integrator,
+                         ThreadPool& pool);
@@ -1,5 +1,62 @@
 #include "ComputeGPU.hpp"
 
+void copy_buffer(ArrayBufferObject& from, ArrayBufferObject& to, size_t bytes) {
+    glCopyNamedBufferSubData(buffer_name(from), buffer_name(to), 0, 0, GLsizeiptr(bytes));
+}
+
+FencedReadback::~FencedReadback() {
+    release();
+}
+
+void FencedReadback::release() {
+    if(fence)
+        glDeleteSync(fence);
+    if(staging) {
+        glUnmapNamedBuffer(staging);
+        glDeleteBuffers(1, &staging);
+    }
+    fence = nullptr;
+    staging = 0;
+    capacity = 0;
+    mapped = nullptr;
+}
+
+void FencedReadback::request(ArrayBufferObject& source, size_t bytes) {
+    if(bytes > capacity) {
+        release();
+        constexpr GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glCreateBuffers(1, &staging);
+        glNamedBufferStorage(staging, GLsizeiptr(bytes), nullptr, flags);
+        mapped = glMapNamedBufferRange(staging, 0, GLsizeiptr(bytes), flags);
+        capacity = bytes;
+    }
+    if(fence)
+        glDeleteSync(fence);
+    // the source was written by image stores
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glCopyNamedBufferSubData(buffer_name(source), staging, 0, 0, GLsizeiptr(bytes));
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+bool FencedReadback::is_pending() const {
+    return fence != nullptr;
+}
+
+const void* FencedReadback::wait() {
+    if(fence) {
+        constexpr GLuint64 timeout_ns = 100'000'000;
+        while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    return mapped;
+}
+
+GravityComputeGPU::GravityComputeGPU(GravityKernelConfig kernel_config) {
+    if(kernel_config.kernel == GravityKernel::Tiled)
+        tiled.emplace(kernel_config.local_size);
+}
+
 void GravityComputeGPU::set_vbos(ArrayBufferObject& position_in,
                                  ArrayBufferObject& velocity_in,
                                  ArrayBufferObject& mass_in,
@@ -10,14 +67,61 @@ void GravityComputeGPU::set_vbos(ArrayBufferObject& position_in,
     shader.set_mass_in(mass_in);
     shader.set_position_out(position_out);
     shader.set_velocity_out(velocity_out);
+    if(tiled) {
+        tiled->set_position_in(position_in);
+        tiled->set_velocity_in(velocity_in);
+        tiled->set_mass_in(mass_in);
+        tiled->set_position_out(position_out);
+        tiled->set_velocity_out(velocity_out);
+    }
+}
+
+void GravityComputeGPU::reserve(size_t bodies_count) {
+    derivatives.bind().init<glm::vec4>(bodies_count * 2);
+    predicted_positions.bind().init<glm::vec4>(bodies_count);
+    predicted_velocities.bind().init<glm::vec4>(bodies_count);
+    shader.set_derivatives(derivatives);
+    shader.set_predicted_position(predicted_positions);
+    shader.set_predicted_velocity(predicted_velocities);
+    if(tiled) {
+        tiled->set_derivatives(derivatives);
+        tiled->set_predicted_position(predicted_positions);
+        tiled->set_predicted_velocity(predicted_velocities);
+    }
 }
 
-void GravityComputeGPU::calculate(size_t bodies_count, float G) {
+void GravityComputeGPU::run_stage(GravityShaderStage stage, size_t bodies_count, float G, const IntegratorConfig& integrator) {
+    if(tiled) {
+        if(auto program = tiled->use_program(); true) {
+            program.set_G(G);
+            program.set_elements_count(bodies_count);
+            program.set_dt(integrator.dt);
+            program.set_scheme((GLint)integrator.scheme);
+            program.set_stage(stage);
+            tiled->dispatch(bodies_count);
+        }
+        tiled->barrier();
+        return;
+    }
     if(auto program = shader.use_program(); true) {
         program.set_G(G);
         program.set_elements_count(bodies_count);
+        program.set_dt(integrator.dt);
+        program.set_scheme((GLint)integrator.scheme);
+        program.set_stage(stage);
         shader.dispatch(bodies_count, 1, 1);
 
     }
     shader.barrier();
 }
+
+void GravityComputeGPU::calculate(size_t bodies_count, float G, const IntegratorConfig& integrator, bool derivatives_valid) {
+    if(integrator.scheme == IntegrationScheme::Euler) {
+        run_stage(GravityShaderStage::Advance, bodies_count, G, integrator);
+        return;
+    }
+    if(!derivatives_valid)
+        run_stage(GravityShaderStage::Init, bodies_count, G, integrator);
+    run_stage(GravityShaderStage::Advance, bodies_count, G, integrator);
+    run_stage(GravityShaderStage::Finish, bodies_count, G, integrator);
+}
@@ -1,16 +1,70 @@
 #pragma once
 
+#include <optional>
+
+#include "Bodies.hpp"
 #include "GravityComputeShader.hpp"
+#include "Integrator.hpp"
+
+// device-side copy of the first bytes of from into to
+void copy_buffer(ArrayBufferObject& from, ArrayBufferObject& to, size_t bytes);
+
+// Reads a device buffer back through a persistently mapped staging buffer.
+// request() only queues a device-side copy and a fence, wait() blocks until
+// the fence is signalled and returns the mapped data, valid until the next
+// request(). Needs GL 4.5 (buffer storage and direct state access).
+class FencedReadback {
+    GLuint staging = 0;
+    size_t capacity = 0;
+    const void* mapped = nullptr;
+    GLsync fence = nullptr;
+
+    void release();
+public:
+    FencedReadback() = default;
+    ~FencedReadback();
+    FencedReadback(const FencedReadback&) = delete;
+    FencedReadback& operator=(const FencedReadback&) = delete;
+
+    void request(ArrayBufferObject& source, size_t bytes);
+    bool is_pending() const;
+    const void* wait();
+};
+
+enum class GravityKernel {
+    // one invocation per workgroup, image buffers
+    Simple,
+    // TiledGravityComputeShader
+    Tiled
+};
+
+struct GravityKernelConfig {
+    GravityKernel kernel = GravityKernel::Tiled;
+    GLuint local_size = 128;
+};
 
 class GravityComputeGPU {
     VertexArrayObject vao;
     GravityComputeShader shader;
+    std::optional<TiledGravityComputeShader> tiled;
+    ArrayBufferObject derivatives;
+    ArrayBufferObject predicted_positions;
+    ArrayBufferObject predicted_velocities;
+
+    void run_stage(GravityShaderStage stage, size_t bodies_count, float G, const IntegratorConfig& integrator);
 public:
+    explicit GravityComputeGPU(GravityKernelConfig kernel_config = {});
+
     void set_vbos(ArrayBufferObject& position_in,
                   ArrayBufferObject& velocity_in,
                   ArrayBufferObject& mass_in,
                   ArrayBufferObject& position_out,
                   ArrayBufferObject& velocity_out);
 
-    void calculate(size_t bodies_count, float G);
+    // scratch state kept between steps, sized for bodies_count bodies
+    void reserve(size_t bodies_count);
+
+    // derivatives_valid: the accelerations (and jerks) left by the previous
+    // call still belong to the bodies uploaded as input
+    void calculate(size_t bodies_count, float G, const IntegratorConfig& integrator, bool derivatives_valid);
 };
@@ -0,0 +1,113 @@
+#include "ComputeRoutine.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include "Utils.hpp"
+
+void ComputeRoutineRegistry::add(std::string name, ComputeRoutineFactory factory) {
+    entries.emplace_back(std::move(name), std::move(factory));
+}
+
+bool ComputeRoutineRegistry::contains(const std::string& name) const {
+    return std::ranges::any_of(entries, [&](const auto& entry) { return entry.first == name; });
+}
+
+std::vector<std::string> ComputeRoutineRegistry::names() const {
+    std::vector<std::string> result;
+    for(const auto& entry : entries)
+        result.push_back(entry.first);
+    return result;
+}
+
+std::unique_ptr<ComputeRoutine> ComputeRoutineRegistry::create(const std::string& name) const {
+    auto entry = std::ranges::find_if(entries, [&](const auto& entry) { return entry.first == name; });
+    if(entry == entries.end())
+        throw std::runtime_error("unknown compute routine " + name);
+    return entry->second();
+}
+
+CalibratingRoutine::CalibratingRoutine(const ComputeRoutineRegistry& registry,
+                                       const Bodies& bodies,
+                                       CalibrationConfig config)
+    : registry(registry)
+    , bodies(bodies)
+    , config(config) {}
+
+void CalibratingRoutine::start_calibration() {
+    candidates = registry.names();
+    if(candidates.empty())
+        throw std::runtime_error("no compute routine to calibrate");
+    if(current)
+        current->sync_bodies();
+    calibrating = true;
+    calibrated_count = bodies.get_count();
+    candidate = 0;
+    candidate_step = 0;
+    candidate_time = std::numeric_limits<double>::infinity();
+    best_time = std::numeric_limits<double>::infinity();
+    best.reset();
+    current = registry.create(candidates[candidate]);
+}
+
+void CalibratingRoutine::calibration_step() {
+    Timer<std::chrono::duration<double, std::milli>> timer;
+    current->compute();
+    candidate_time = std::min(candidate_time, timer.elapsed().count());
+    if(++candidate_step < std::max<size_t>(config.steps, 1))
+        return;
+
+    std::cerr << "calibration: " << candidates[candidate] << " " << candidate_time
+              << " ms/step at " << calibrated_count << " bodies\n";
+    current->sync_bodies();
+    if(candidate_time < best_time) {
+        best_time = candidate_time;
+        best = std::move(current);
+        best_name = candidates[candidate];
+    }
+    candidate_step = 0;
+    candidate_time = std::numeric_limits<double>::infinity();
+    if(++candidate < candidates.size()) {
+        current = registry.create(candidates[candidate]);
+        return;
+    }
+    calibrating = false;
+    // the last candidate stepped the bodies after the best one did
+    if(best_name != candidates.back())
+        best->reload_bodies();
+    current = std::move(best);
+    std::cerr << "calibration: using " << best_name << "\n";
+}
+
+void CalibratingRoutine::compute() {
+    if(!calibrating && (!current || float(bodies.get_count()) * config.recalibrate_factor <= float(calibrated_count)))
+        start_calibration();
+    if(calibrating)
+        calibration_step();
+    else
+        current->compute();
+}
+
+Integrator* CalibratingRoutine::get_integrator() {
+    return current ? current->get_integrator() : nullptr;
+}
+
+void CalibratingRoutine::sync_bodies() {
+    if(current)
+        current->sync_bodies();
+}
+
+void CalibratingRoutine::reload_bodies() {
+    if(current)
+        current->reload_bodies();
+}
+
+bool CalibratingRoutine::is_calibrating() const {
+    return calibrating;
+}
+
+const std::string& CalibratingRoutine::selected() const {
+    return best_name;
+}
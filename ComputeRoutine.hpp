@@ -0,0 +1,83 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Bodies.hpp"
+#include "Integrator.hpp"
+
+// One simulation step per compute(): collisions, gravity and whatever
+// upload or download the backend needs.
+struct ComputeRoutine {
+    virtual ~ComputeRoutine() = default;
+    virtual void compute() = 0;
+    // the integrator a checkpoint saves and restores, if the backend keeps
+    // its state on the host
+    virtual Integrator* get_integrator() { return nullptr; }
+    // Hand-over between routines sharing the same bodies: sync_bodies()
+    // writes state the backend keeps elsewhere back into bodies,
+    // reload_bodies() drops whatever the backend derived from bodies before
+    // another routine changed them.
+    virtual void sync_bodies() {}
+    virtual void reload_bodies() {}
+};
+
+using ComputeRoutineFactory = std::function<std::unique_ptr<ComputeRoutine>()>;
+
+// Backends by name, in the order they were added. The factories capture
+// whatever their routine needs (bodies, buffers, pool), so the same registry
+// serves the GUI and the headless targets.
+class ComputeRoutineRegistry {
+    std::vector<std::pair<std::string, ComputeRoutineFactory>> entries;
+public:
+    void add(std::string name, ComputeRoutineFactory factory);
+    bool contains(const std::string& name) const;
+    std::vector<std::string> names() const;
+    // throws std::runtime_error for an unknown name
+    std::unique_ptr<ComputeRoutine> create(const std::string& name) const;
+};
+
+struct CalibrationConfig {
+    // timed steps per candidate, the fastest one counts
+    size_t steps = 3;
+    // calibrate again once mergers shrink the body count by this factor
+    float recalibrate_factor = 4.0f;
+};
+
+// Times a few steps of every registered backend at the current body count
+// and keeps the fastest one. Every compute() is still exactly one step, the
+// calibration steps advance the simulation like any other, so each switch
+// between backends syncs the one stepped last and reloads the next.
+class CalibratingRoutine : public ComputeRoutine {
+    const ComputeRoutineRegistry& registry;
+    const Bodies& bodies;
+    CalibrationConfig config;
+    std::vector<std::string> candidates;
+    size_t candidate = 0;
+    size_t candidate_step = 0;
+    double candidate_time = 0.0;
+    double best_time = 0.0;
+    std::unique_ptr<ComputeRoutine> current;
+    std::unique_ptr<ComputeRoutine> best;
+    std::string best_name;
+    bool calibrating = false;
+    size_t calibrated_count = 0;
+
+    void start_calibration();
+    void calibration_step();
+public:
+    CalibratingRoutine(const ComputeRoutineRegistry& registry,
+                       const Bodies& bodies,
+                       CalibrationConfig config = {});
+
+    void compute() override;
+    // the current candidate's during calibration
+    Integrator* get_integrator() override;
+    void sync_bodies() override;
+    void reload_bodies() override;
+    bool is_calibrating() const;
+    // the fastest backend so far, empty before the first compute()
+    const std::string& selected() const;
+};
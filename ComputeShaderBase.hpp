@@ -6,6 +6,14 @@
 #include <glm/glm.hpp>
 #include <array>
 
+// GL name of the buffer behind vbo
+inline GLuint buffer_name(ArrayBufferObject& vbo) {
+    [[maybe_unused]] auto bound = vbo.bind();
+    GLint name = 0;
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &name);
+    return GLuint(name);
+}
+
 template<typename T>
 struct type_to_format;
 
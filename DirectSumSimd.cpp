@@ -0,0 +1,183 @@
+#include "DirectSumSimd.hpp"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GRAVITY_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+SimdIsa detect_simd_isa() {
+#ifdef GRAVITY_SIMD_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+        return SimdIsa::AVX512;
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SimdIsa::AVX2;
+#endif
+    return SimdIsa::Scalar;
+}
+
+const char* simd_isa_name(SimdIsa isa) {
+    switch(isa) {
+    case SimdIsa::Scalar: return "scalar";
+    case SimdIsa::AVX2: return "avx2";
+    case SimdIsa::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+void SplitBodies::load(const std::vector<glm::vec4>& positions,
+                       const std::vector<float>& masses,
+                       size_t bodies_count) {
+    count = bodies_count;
+    auto padded = padded_count();
+    for(auto stream : {&x, &y, &z, &m})
+        stream->assign(padded, 0.0f);
+    for(size_t i = 0; i < count; ++i) {
+        x[i] = positions[i].x;
+        y[i] = positions[i].y;
+        z[i] = positions[i].z;
+        m[i] = masses[i];
+    }
+}
+
+size_t SplitBodies::padded_count() const {
+    return (count + padding - 1) / padding * padding;
+}
+
+namespace {
+void accelerations_scalar(const SplitBodies& b, size_t begin, size_t end, glm::vec3* acc) {
+    for(auto i = begin; i < end; ++i) {
+        glm::vec3 a{0.0f};
+        for(size_t j = 0; j < b.count; ++j) {
+            glm::vec3 d{b.x[j] - b.x[i], b.y[j] - b.y[i], b.z[j] - b.z[i]};
+            auto r2 = glm::dot(d, d);
+            if(r2 == 0.0f)
+                continue;
+            auto inv = 1.0f / std::sqrt(r2);
+            a += d * (b.m[j] * inv * inv * inv);
+        }
+        acc[i - begin] = a;
+    }
+}
+
+#ifdef GRAVITY_SIMD_X86
+__attribute__((target("avx2,fma")))
+float hsum_avx2(__m256 v) {
+    auto s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_hadd_ps(s, s);
+    s = _mm_hadd_ps(s, s);
+    return _mm_cvtss_f32(s);
+}
+
+// rsqrt estimate refined with one Newton step: y = y * (1.5 - 0.5 * r2 * y^2)
+__attribute__((target("avx2,fma")))
+void accelerations_avx2(const SplitBodies& b, size_t begin, size_t end, glm::vec3* acc) {
+    auto n = b.padded_count();
+    const auto zero = _mm256_setzero_ps();
+    const auto half = _mm256_set1_ps(0.5f);
+    const auto three_halves = _mm256_set1_ps(1.5f);
+    for(auto i = begin; i < end; ++i) {
+        auto xi = _mm256_set1_ps(b.x[i]);
+        auto yi = _mm256_set1_ps(b.y[i]);
+        auto zi = _mm256_set1_ps(b.z[i]);
+        auto ax = zero, ay = zero, az = zero;
+        for(size_t j = 0; j < n; j += 8) {
+            auto dx = _mm256_sub_ps(_mm256_loadu_ps(&b.x[j]), xi);
+            auto dy = _mm256_sub_ps(_mm256_loadu_ps(&b.y[j]), yi);
+            auto dz = _mm256_sub_ps(_mm256_loadu_ps(&b.z[j]), zi);
+            auto r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+            auto inv = _mm256_rsqrt_ps(r2);
+            inv = _mm256_mul_ps(inv, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2),
+                                                      _mm256_mul_ps(inv, inv),
+                                                      three_halves));
+            auto inv3 = _mm256_mul_ps(_mm256_mul_ps(inv, inv), inv);
+            auto s = _mm256_and_ps(_mm256_mul_ps(_mm256_loadu_ps(&b.m[j]), inv3),
+                                   _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+            ax = _mm256_fmadd_ps(dx, s, ax);
+            ay = _mm256_fmadd_ps(dy, s, ay);
+            az = _mm256_fmadd_ps(dz, s, az);
+        }
+        acc[i - begin] = {hsum_avx2(ax), hsum_avx2(ay), hsum_avx2(az)};
+    }
+}
+
+__attribute__((target("avx512f")))
+float hsum_avx512(__m512 v) {
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, v);
+    float sum = 0.0f;
+    for(auto lane : lanes)
+        sum += lane;
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+void accelerations_avx512(const SplitBodies& b, size_t begin, size_t end, glm::vec3* acc) {
+    auto n = b.padded_count();
+    const auto zero = _mm512_setzero_ps();
+    const auto half = _mm512_set1_ps(0.5f);
+    const auto three_halves = _mm512_set1_ps(1.5f);
+    for(auto i = begin; i < end; ++i) {
+        auto xi = _mm512_set1_ps(b.x[i]);
+        auto yi = _mm512_set1_ps(b.y[i]);
+        auto zi = _mm512_set1_ps(b.z[i]);
+        auto ax = zero, ay = zero, az = zero;
+        for(size_t j = 0; j < n; j += 16) {
+            auto dx = _mm512_sub_ps(_mm512_loadu_ps(&b.x[j]), xi);
+            auto dy = _mm512_sub_ps(_mm512_loadu_ps(&b.y[j]), yi);
+            auto dz = _mm512_sub_ps(_mm512_loadu_ps(&b.z[j]), zi);
+            auto r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+            auto inv = _mm512_maskz_rsqrt14_ps(__mmask16(-1), r2);
+            inv = _mm512_mul_ps(inv, _mm512_fnmadd_ps(_mm512_mul_ps(half, r2),
+                                                      _mm512_mul_ps(inv, inv),
+                                                      three_halves));
+            auto inv3 = _mm512_mul_ps(_mm512_mul_ps(inv, inv), inv);
+            auto s = _mm512_maskz_mul_ps(_mm512_cmp_ps_mask(r2, zero, _CMP_GT_OQ),
+                                         _mm512_loadu_ps(&b.m[j]),
+                                         inv3);
+            ax = _mm512_fmadd_ps(dx, s, ax);
+            ay = _mm512_fmadd_ps(dy, s, ay);
+            az = _mm512_fmadd_ps(dz, s, az);
+        }
+        acc[i - begin] = {hsum_avx512(ax), hsum_avx512(ay), hsum_avx512(az)};
+    }
+}
+#endif
+}
+
+void calc_accelerations_simd(const SplitBodies& bodies,
+                             size_t begin,
+                             size_t end,
+                             glm::vec3* acc,
+                             SimdIsa isa) {
+    switch(isa) {
+#ifdef GRAVITY_SIMD_X86
+    case SimdIsa::AVX512:
+        accelerations_avx512(bodies, begin, end, acc);
+        return;
+    case SimdIsa::AVX2:
+        accelerations_avx2(bodies, begin, end, acc);
+        return;
+#endif
+    default:
+        accelerations_scalar(bodies, begin, end, acc);
+        return;
+    }
+}
+
+std::vector<glm::vec4> calc_forces_simd(const SplitBodies& bodies,
+                                        float G,
+                                        ThreadPool& pool,
+                                        SimdIsa isa) {
+    std::vector<glm::vec4> forces(bodies.count);
+    pool.parallel_for(0, bodies.count, 64, [&](size_t begin, size_t end) {
+        thread_local std::vector<glm::vec3> acc;
+        acc.resize(end - begin);
+        calc_accelerations_simd(bodies, begin, end, acc.data(), isa);
+        for(auto i = begin; i < end; ++i)
+            forces[i] = glm::vec4(acc[i - begin] * (G * bodies.m[i]), 0.0f);
+    });
+    return forces;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+
+enum class SimdIsa {
+    Scalar,
+    AVX2,
+    AVX512
+};
+
+SimdIsa detect_simd_isa();
+const char* simd_isa_name(SimdIsa isa);
+
+// Positions and masses split into separate float streams, padded with
+// massless bodies to a multiple of the widest vector.
+struct SplitBodies {
+    static constexpr size_t padding = 16;
+
+    std::vector<float> x, y, z, m;
+    size_t count{0};
+
+    void load(const std::vector<glm::vec4>& positions,
+              const std::vector<float>& masses,
+              size_t bodies_count);
+    size_t padded_count() const;
+};
+
+// acc[i - begin] = sum_j m_j * (p_j - p_i) / |p_j - p_i|^3 for targets [begin, end)
+void calc_accelerations_simd(const SplitBodies& bodies,
+                             size_t begin,
+                             size_t end,
+                             glm::vec3* acc,
+                             SimdIsa isa);
+
+std::vector<glm::vec4> calc_forces_simd(const SplitBodies& bodies,
+                                        float G,
+                                        ThreadPool& pool,
+                                        SimdIsa isa = detect_simd_isa());
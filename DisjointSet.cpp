@@ -0,0 +1,165 @@
+#include "DisjointSet.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <utility>
+
+namespace {
+constexpr auto no_group = ~uint32_t(0);
+}
+
+void FlatGroups::assign(const std::vector<uint32_t>& roots, size_t count) {
+    counts.assign(count, 0);
+    for(size_t i = 0; i < count; ++i)
+        ++counts[roots[i]];
+
+    // groups are numbered on first appearance, counts turn into fill cursors
+    group_of_root.assign(count, no_group);
+    begin.assign(1, 0);
+    for(size_t i = 0; i < count; ++i) {
+        auto root = roots[i];
+        if(counts[root] < 2 || group_of_root[root] != no_group)
+            continue;
+        group_of_root[root] = uint32_t(begin.size() - 1);
+        begin.push_back(begin.back() + counts[root]);
+        counts[root] = begin[begin.size() - 2];
+    }
+
+    members.resize(begin.back());
+    for(size_t i = 0; i < count; ++i)
+        if(group_of_root[roots[i]] != no_group)
+            members[counts[roots[i]]++] = uint32_t(i);
+}
+
+void FlatGroups::assign(const std::vector<uint32_t>& roots, size_t count, ThreadPool& pool) {
+    counts.assign(count, 0);
+    group_of_root.resize(count);
+    pool.parallel_for(0, count, [&](size_t first, size_t last) {
+        for(auto i = first; i < last; ++i)
+            std::atomic_ref(counts[roots[i]]).fetch_add(1, std::memory_order_relaxed);
+    });
+
+    // roots are the smallest members, so numbering them in index order
+    // yields the same group order as the serial version
+    auto groups_count = parallel_exclusive_scan(pool, count,
+        [&](size_t r) { return size_t(counts[r] > 1); },
+        [&](size_t r, size_t group) { group_of_root[r] = counts[r] > 1 ? uint32_t(group) : no_group; });
+    begin.resize(groups_count + 1);
+    auto members_count = parallel_exclusive_scan(pool, count,
+        [&](size_t r) { return group_of_root[r] != no_group ? size_t(counts[r]) : 0; },
+        [&](size_t r, size_t offset) {
+            if(group_of_root[r] != no_group)
+                begin[group_of_root[r]] = uint32_t(offset);
+        });
+    begin[groups_count] = uint32_t(members_count);
+
+    members.resize(members_count);
+    pool.parallel_for(0, count, [&](size_t first, size_t last) {
+        for(auto r = first; r < last; ++r)
+            if(group_of_root[r] != no_group)
+                counts[r] = begin[group_of_root[r]];
+    });
+    pool.parallel_for(0, count, [&](size_t first, size_t last) {
+        for(auto i = first; i < last; ++i) {
+            auto group = group_of_root[roots[i]];
+            if(group != no_group)
+                members[std::atomic_ref(counts[roots[i]]).fetch_add(1, std::memory_order_relaxed)] = uint32_t(i);
+        }
+    });
+    pool.parallel_for(0, groups_count, [&](size_t first, size_t last) {
+        for(auto g = first; g < last; ++g)
+            std::sort(members.begin() + begin[g], members.begin() + begin[g + 1]);
+    });
+}
+
+size_t FlatGroups::size() const {
+    return begin.size() - 1;
+}
+
+std::span<const uint32_t> FlatGroups::operator[](size_t group) const {
+    return {members.data() + begin[group], members.data() + begin[group + 1]};
+}
+
+void DisjointSet::reset(size_t count) {
+    parent.resize(count);
+    std::iota(parent.begin(), parent.end(), 0u);
+    rank.assign(count, 0);
+}
+
+uint32_t DisjointSet::find(uint32_t x) {
+    while(parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+bool DisjointSet::unite(uint32_t a, uint32_t b) {
+    a = find(a);
+    b = find(b);
+    if(a == b)
+        return false;
+    if(rank[a] < rank[b])
+        std::swap(a, b);
+    parent[b] = a;
+    if(rank[a] == rank[b])
+        ++rank[a];
+    return true;
+}
+
+void DisjointSet::collect(FlatGroups& groups) {
+    roots.resize(parent.size());
+    for(uint32_t i = 0; i < parent.size(); ++i)
+        roots[i] = find(i);
+    groups.assign(roots, parent.size());
+}
+
+void ConcurrentDisjointSet::reset(size_t count) {
+    parent.resize(count);
+    std::iota(parent.begin(), parent.end(), 0u);
+}
+
+uint32_t ConcurrentDisjointSet::find(uint32_t x) {
+    while(true) {
+        auto p = std::atomic_ref(parent[x]).load(std::memory_order_acquire);
+        if(p == x)
+            return x;
+        auto grandparent = std::atomic_ref(parent[p]).load(std::memory_order_acquire);
+        // parents only ever decrease, a lost halving race is harmless
+        if(grandparent != p)
+            std::atomic_ref(parent[x]).compare_exchange_weak(p, grandparent, std::memory_order_release,
+                                                             std::memory_order_relaxed);
+        x = grandparent;
+    }
+}
+
+bool ConcurrentDisjointSet::unite(uint32_t a, uint32_t b) {
+    while(true) {
+        a = find(a);
+        b = find(b);
+        if(a == b)
+            return false;
+        if(a > b)
+            std::swap(a, b);
+        auto expected = b;
+        if(std::atomic_ref(parent[b]).compare_exchange_strong(expected, a, std::memory_order_acq_rel))
+            return true;
+    }
+}
+
+void ConcurrentDisjointSet::collect(FlatGroups& groups) {
+    roots.resize(parent.size());
+    for(uint32_t i = 0; i < parent.size(); ++i)
+        roots[i] = find(i);
+    groups.assign(roots, parent.size());
+}
+
+void ConcurrentDisjointSet::collect(FlatGroups& groups, ThreadPool& pool) {
+    roots.resize(parent.size());
+    pool.parallel_for(0, parent.size(), [&](size_t first, size_t last) {
+        for(auto i = first; i < last; ++i)
+            roots[i] = find(uint32_t(i));
+    });
+    groups.assign(roots, parent.size(), pool);
+}
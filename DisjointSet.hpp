@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <cstdint>
+
+#include "ThreadPool.hpp"
+
+// Sets with more than one member stored back to back: group g is
+// members[begin[g] .. begin[g + 1]). Groups are ordered by their smallest
+// member and members ascend within a group.
+class FlatGroups {
+    std::vector<uint32_t> begin;
+    std::vector<uint32_t> members;
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> group_of_root;
+public:
+    // roots[i] is the representative of element i
+    void assign(const std::vector<uint32_t>& roots, size_t count);
+    // parallel version, every root has to be the smallest member of its set
+    void assign(const std::vector<uint32_t>& roots, size_t count, ThreadPool& pool);
+
+    size_t size() const;
+    std::span<const uint32_t> operator[](size_t group) const;
+};
+
+// Union by rank with path halving over element indices.
+class DisjointSet {
+    std::vector<uint32_t> parent;
+    std::vector<uint8_t> rank;
+    std::vector<uint32_t> roots;
+public:
+    void reset(size_t count);
+    uint32_t find(uint32_t x);
+    bool unite(uint32_t a, uint32_t b);
+    void collect(FlatGroups& groups);
+};
+
+// Lock-free variant: find and unite may run from many threads at once. The
+// larger root is always linked under the smaller one, so every set ends up
+// represented by its smallest index whatever order the unions land in.
+class ConcurrentDisjointSet {
+    std::vector<uint32_t> parent;
+    std::vector<uint32_t> roots;
+public:
+    void reset(size_t count);
+    uint32_t find(uint32_t x);
+    bool unite(uint32_t a, uint32_t b);
+    void collect(FlatGroups& groups);
+    void collect(FlatGroups& groups, ThreadPool& pool);
+};
@@ -0,0 +1,325 @@
+#include "FastMultipole.hpp"
+
+#include <algorithm>
+#include <ranges>
+
+namespace {
+double binomial(int n, int k) {
+    double val = 1.0;
+    for(int i = 1; i <= k; ++i)
+        val = val * (n - k + i) / i;
+    return val;
+}
+
+double binomial(glm::ivec3 n, glm::ivec3 k) {
+    return binomial(n.x, k.x) * binomial(n.y, k.y) * binomial(n.z, k.z);
+}
+
+int degree(glm::ivec3 n) {
+    return n.x + n.y + n.z;
+}
+}
+
+FastMultipole::FastMultipole(size_t order, float theta, size_t leaf_capacity)
+    : order(std::max<size_t>(1, order))
+    , theta(theta)
+    , tree(leaf_capacity) {
+    init_tables();
+}
+
+size_t FastMultipole::coeff_count() const {
+    return indices.size();
+}
+
+uint32_t FastMultipole::index_of(int x, int y, int z) const {
+    auto side = order + 1;
+    return lookup[(x * side + y) * side + z];
+}
+
+void FastMultipole::init_tables() {
+    int p = order;
+    auto side = order + 1;
+    lookup.assign(side * side * side, -1);
+    for(int d = 0; d <= p; ++d)
+        for(int x = d; x >= 0; --x)
+            for(int y = d - x; y >= 0; --y) {
+                int z = d - x - y;
+                lookup[(x * side + y) * side + z] = indices.size();
+                indices.push_back({x, y, z});
+            }
+
+    for(auto n : indices) {
+        int axis = n.x > 0 ? 0 : n.y > 0 ? 1 : 2;
+        auto prev = n;
+        prev[axis] = std::max(0, prev[axis] - 1);
+        mono_axis.push_back(axis);
+        mono_prev.push_back(index_of(prev.x, prev.y, prev.z));
+    }
+
+    for(uint32_t k_id = 0; k_id < indices.size(); ++k_id) {
+        auto k = indices[k_id];
+        for(uint32_t l_id = 0; l_id < indices.size(); ++l_id) {
+            auto l = indices[l_id];
+            if(l.x > k.x || l.y > k.y || l.z > k.z)
+                continue;
+            auto shift = index_of(k.x - l.x, k.y - l.y, k.z - l.z);
+            m2m_terms.push_back({k_id, l_id, shift, binomial(k, l)});
+            // L'_l = sum C(k, l) e^(k - l) L_k
+            l2l_terms.push_back({l_id, k_id, shift, binomial(k, l)});
+        }
+    }
+
+    for(uint32_t n_id = 0; n_id < indices.size(); ++n_id) {
+        auto n = indices[n_id];
+        for(uint32_t k_id = 0; k_id < indices.size(); ++k_id) {
+            auto k = indices[k_id];
+            if(degree(n) + degree(k) > p)
+                continue;
+            auto sum = n + k;
+            auto sign = degree(k) % 2 ? -1.0 : 1.0;
+            m2l_terms.push_back({n_id, k_id, index_of(sum.x, sum.y, sum.z), sign * binomial(sum, n)});
+        }
+    }
+}
+
+void FastMultipole::monomials(glm::dvec3 v, double* out) const {
+    out[0] = 1.0;
+    for(size_t i = 1; i < coeff_count(); ++i)
+        out[i] = out[mono_prev[i]] * v[mono_axis[i]];
+}
+
+// Taylor coefficients of 1/|r|: D_n = (1/n!) d^n/dr^n (1/|r|), from the recurrence
+// |n| r^2 D_n + (2|n| - 1) sum_i r_i D_(n-e_i) + (|n| - 1) sum_i D_(n-2e_i) = 0
+void FastMultipole::derivatives(glm::dvec3 r, double* out) const {
+    auto r2 = glm::dot(r, r);
+    out[0] = 1.0 / std::sqrt(r2);
+    for(size_t i = 1; i < coeff_count(); ++i) {
+        auto n = indices[i];
+        auto d = degree(n);
+        double sum = 0.0;
+        for(int axis = 0; axis < 3; ++axis) {
+            auto prev = n;
+            if(n[axis] >= 1) {
+                prev[axis] -= 1;
+                sum += (2 * d - 1) * r[axis] * out[index_of(prev.x, prev.y, prev.z)];
+            }
+            if(n[axis] >= 2) {
+                prev[axis] -= 1;
+                sum += (d - 1) * out[index_of(prev.x, prev.y, prev.z)];
+            }
+        }
+        out[i] = -sum / (d * r2);
+    }
+}
+
+void FastMultipole::particles_to_multipole(uint32_t node_id,
+                                           const glm::vec4* positions,
+                                           const float* masses) {
+    auto& node = tree.get_nodes()[node_id];
+    auto& order_ids = tree.get_order();
+    auto nc = coeff_count();
+    auto moments = &multipoles[node_id * nc];
+    thread_local std::vector<double> mono;
+    mono.resize(nc);
+    for(auto i = node.body_begin; i < node.body_end; ++i) {
+        auto id = order_ids[i];
+        monomials(glm::dvec3(glm::vec3(positions[id]) - node.center), mono.data());
+        for(size_t k = 0; k < nc; ++k)
+            moments[k] += masses[id] * mono[k];
+    }
+}
+
+void FastMultipole::multipole_to_multipole(uint32_t node_id) {
+    auto& nodes = tree.get_nodes();
+    auto& node = nodes[node_id];
+    auto nc = coeff_count();
+    auto moments = &multipoles[node_id * nc];
+    thread_local std::vector<double> mono;
+    mono.resize(nc);
+    for(auto child_id = node.first_child; child_id < node.first_child + node.child_count; ++child_id) {
+        monomials(glm::dvec3(nodes[child_id].center - node.center), mono.data());
+        auto child_moments = &multipoles[child_id * nc];
+        for(auto& t : m2m_terms)
+            moments[t.out] += t.coef * mono[t.shift] * child_moments[t.in];
+    }
+}
+
+void FastMultipole::multipole_to_local(uint32_t target_id, uint32_t source_id) {
+    auto& nodes = tree.get_nodes();
+    auto nc = coeff_count();
+    thread_local std::vector<double> deriv;
+    deriv.resize(nc);
+    derivatives(glm::dvec3(nodes[target_id].center - nodes[source_id].center), deriv.data());
+
+    auto moments = &multipoles[source_id * nc];
+    auto local = &locals[target_id * nc];
+    for(auto& t : m2l_terms)
+        local[t.out] += t.coef * moments[t.in] * deriv[t.shift];
+}
+
+void FastMultipole::local_to_local(uint32_t parent_id, uint32_t child_id) {
+    auto& nodes = tree.get_nodes();
+    auto nc = coeff_count();
+    thread_local std::vector<double> mono;
+    mono.resize(nc);
+    monomials(glm::dvec3(nodes[child_id].center - nodes[parent_id].center), mono.data());
+    auto parent = &locals[parent_id * nc];
+    auto child = &locals[child_id * nc];
+    for(auto& t : l2l_terms)
+        child[t.out] += t.coef * mono[t.shift] * parent[t.in];
+}
+
+void FastMultipole::local_to_particles(uint32_t node_id, const glm::vec4* positions) {
+    auto& node = tree.get_nodes()[node_id];
+    auto& order_ids = tree.get_order();
+    auto nc = coeff_count();
+    auto local = &locals[node_id * nc];
+    thread_local std::vector<double> mono;
+    mono.resize(nc);
+    for(auto i = node.body_begin; i < node.body_end; ++i) {
+        auto id = order_ids[i];
+        monomials(glm::dvec3(glm::vec3(positions[id]) - node.center), mono.data());
+        glm::dvec3 grad{0.0};
+        for(size_t n_id = 1; n_id < nc; ++n_id) {
+            auto n = indices[n_id];
+            for(int axis = 0; axis < 3; ++axis) {
+                if(n[axis] == 0)
+                    continue;
+                auto prev = n;
+                prev[axis] -= 1;
+                grad[axis] += local[n_id] * n[axis] * mono[index_of(prev.x, prev.y, prev.z)];
+            }
+        }
+        accelerations[id] += glm::vec3(grad);
+    }
+}
+
+void FastMultipole::particles_to_particles(uint32_t target_id, uint32_t source_id,
+                                           const glm::vec4* positions, const float* masses) {
+    auto& nodes = tree.get_nodes();
+    auto& order_ids = tree.get_order();
+    auto& target = nodes[target_id];
+    auto& source = nodes[source_id];
+    for(auto i = target.body_begin; i < target.body_end; ++i) {
+        auto a_id = order_ids[i];
+        auto pos = glm::vec3(positions[a_id]);
+        glm::vec3 acc{0.0f};
+        for(auto j = source.body_begin; j < source.body_end; ++j) {
+            auto b_id = order_ids[j];
+            auto diff = glm::vec3(positions[b_id]) - pos;
+            auto dist2 = glm::dot(diff, diff);
+            if(dist2 == 0.0f)
+                continue;
+            acc += diff * (masses[b_id] / (dist2 * std::sqrt(dist2)));
+        }
+        accelerations[a_id] += acc;
+    }
+}
+
+bool FastMultipole::well_separated(const OctreeNode& a, const OctreeNode& b) const {
+    constexpr float sqrt3 = 1.7320508f;
+    auto radii = (a.half_size + b.half_size) * sqrt3;
+    auto dist = glm::distance(a.center, b.center);
+    return radii < theta * dist;
+}
+
+void FastMultipole::interact(uint32_t target_id, uint32_t source_id,
+                             const glm::vec4* positions, const float* masses) {
+    auto& nodes = tree.get_nodes();
+    auto& target = nodes[target_id];
+    auto& source = nodes[source_id];
+    if(source.mass == 0.0f)
+        return;
+
+    if(well_separated(target, source)) {
+        multipole_to_local(target_id, source_id);
+    } else if(target.is_leaf() && source.is_leaf()) {
+        particles_to_particles(target_id, source_id, positions, masses);
+    } else if(source.is_leaf() || (!target.is_leaf() && target.half_size >= source.half_size)) {
+        for(auto child = target.first_child; child < target.first_child + target.child_count; ++child)
+            interact(child, source_id, positions, masses);
+    } else {
+        for(auto child = source.first_child; child < source.first_child + source.child_count; ++child)
+            interact(target_id, child, positions, masses);
+    }
+}
+
+void FastMultipole::evaluate(uint32_t node_id, const glm::vec4* positions) {
+    auto& node = tree.get_nodes()[node_id];
+    if(node.is_leaf()) {
+        local_to_particles(node_id, positions);
+        return;
+    }
+    for(auto child = node.first_child; child < node.first_child + node.child_count; ++child) {
+        local_to_local(node_id, child);
+        evaluate(child, positions);
+    }
+}
+
+std::vector<glm::vec4> FastMultipole::calc_forces(const std::vector<glm::vec4>& positions,
+                                                  const std::vector<float>& masses,
+                                                  size_t bodies_count,
+                                                  float G,
+                                                  ThreadPool& pool) {
+    std::vector<glm::vec4> forces(bodies_count);
+    if(bodies_count == 0)
+        return forces;
+
+    tree.build(positions, masses, bodies_count);
+    auto& nodes = tree.get_nodes();
+    auto nc = coeff_count();
+    multipoles.assign(nodes.size() * nc, 0.0);
+    locals.assign(nodes.size() * nc, 0.0);
+    accelerations.assign(bodies_count, glm::vec3{0.0f});
+
+    std::vector<std::vector<uint32_t>> levels{{0}};
+    while(true) {
+        std::vector<uint32_t> next;
+        for(auto id : levels.back())
+            for(auto child = nodes[id].first_child; child < nodes[id].first_child + nodes[id].child_count; ++child)
+                next.push_back(child);
+        if(next.empty())
+            break;
+        levels.push_back(std::move(next));
+    }
+
+    for(auto& level : levels | std::views::reverse) {
+        pool.parallel_for(0, level.size(), [&](size_t begin, size_t end) {
+            for(auto i = begin; i < end; ++i) {
+                if(nodes[level[i]].is_leaf())
+                    particles_to_multipole(level[i], positions.data(), masses.data());
+                else
+                    multipole_to_multipole(level[i]);
+            }
+        });
+    }
+
+    // every body belongs to exactly one task subtree, so tasks never write the same locals
+    std::vector<uint32_t> tasks;
+    auto task_size = std::max<size_t>(1, bodies_count / (pool.size() * 16));
+    std::vector<uint32_t> stack{0};
+    while(!stack.empty()) {
+        auto id = stack.back();
+        stack.pop_back();
+        auto& node = nodes[id];
+        if(node.is_leaf() || node.body_end - node.body_begin <= task_size) {
+            tasks.push_back(id);
+            continue;
+        }
+        for(auto child = node.first_child; child < node.first_child + node.child_count; ++child)
+            stack.push_back(child);
+    }
+
+    pool.parallel_for(0, tasks.size(), 1, [&](size_t begin, size_t end) {
+        for(auto i = begin; i < end; ++i) {
+            interact(tasks[i], 0, positions.data(), masses.data());
+            evaluate(tasks[i], positions.data());
+        }
+    });
+
+    pool.parallel_for(0, bodies_count, [&](size_t begin, size_t end) {
+        for(auto id = begin; id < end; ++id)
+            forces[id] = glm::vec4(accelerations[id] * (G * masses[id]), 0.0f);
+    });
+    return forces;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Octree.hpp"
+#include "ThreadPool.hpp"
+
+// Cartesian Taylor-expansion FMM: multipole moments and local expansions are
+// kept up to the given order, cells interact through M2L when
+// (r_a + r_b) < theta * |c_a - c_b|, the rest is summed directly.
+class FastMultipole {
+    struct Term {
+        uint32_t out;
+        uint32_t in;
+        uint32_t shift;
+        double coef;
+    };
+
+    size_t order;
+    float theta;
+    Octree tree;
+
+    std::vector<glm::ivec3> indices;
+    std::vector<int> lookup;
+    std::vector<uint32_t> mono_prev;
+    std::vector<int> mono_axis;
+    std::vector<Term> m2m_terms;
+    std::vector<Term> l2l_terms;
+    std::vector<Term> m2l_terms;
+
+    std::vector<double> multipoles;
+    std::vector<double> locals;
+    std::vector<glm::vec3> accelerations;
+
+    size_t coeff_count() const;
+    uint32_t index_of(int x, int y, int z) const;
+    void init_tables();
+
+    void monomials(glm::dvec3 v, double* out) const;
+    void derivatives(glm::dvec3 r, double* out) const;
+
+    void particles_to_multipole(uint32_t node_id, const glm::vec4* positions, const float* masses);
+    void multipole_to_multipole(uint32_t node_id);
+    void multipole_to_local(uint32_t target_id, uint32_t source_id);
+    void local_to_local(uint32_t parent_id, uint32_t child_id);
+    void local_to_particles(uint32_t node_id, const glm::vec4* positions);
+    void particles_to_particles(uint32_t target_id, uint32_t source_id,
+                                const glm::vec4* positions, const float* masses);
+
+    bool well_separated(const OctreeNode& a, const OctreeNode& b) const;
+    void interact(uint32_t target_id, uint32_t source_id,
+                  const glm::vec4* positions, const float* masses);
+    void evaluate(uint32_t node_id, const glm::vec4* positions);
+public:
+    FastMultipole(size_t order = 4, float theta = 0.5f, size_t leaf_capacity = 32);
+
+    std::vector<glm::vec4> calc_forces(const std::vector<glm::vec4>& positions,
+                                       const std::vector<float>& masses,
+                                       size_t bodies_count,
+                                       float G,
+                                       ThreadPool& pool);
+};
@@ -0,0 +1,376 @@
+#include "GLComputeShaders.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// the memory info extensions are not in the core headers
+#ifndef GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#endif
+#ifndef GL_TEXTURE_FREE_MEMORY_ATI
+#define GL_TEXTURE_FREE_MEMORY_ATI 0x87FC
+#endif
+
+const std::string ForceComputeShader::code = R"(
+#version 430 core
+
+layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+
+uniform layout(rgba32f, binding = 0) readonly imageBuffer position_a;
+uniform layout(r32f, binding = 1) readonly imageBuffer mass_a;
+uniform layout(rgba32f, binding = 2) readonly imageBuffer position_b;
+uniform layout(r32f, binding = 3) readonly imageBuffer mass_b;
+uniform layout(rgba32f, binding = 4) writeonly imageBuffer force_out;
+
+layout(location = 0) uniform float G;
+layout(location = 1) uniform int a_offset;
+layout(location = 2) uniform int b_offset;
+layout(location = 3) uniform int chunk_size;
+
+void main() {
+    int col = int(gl_GlobalInvocationID.x);
+    int row = int(gl_GlobalInvocationID.y);
+    int id = row * chunk_size + col;
+
+    int a_id = a_offset + col;
+    int b_id = b_offset + row;
+
+    vec3 pos_diff = imageLoad(position_a, a_id).xyz - imageLoad(position_b, b_id).xyz;
+    float dist2 = dot(pos_diff, pos_diff);
+
+    if(dist2 == 0.0f) {
+        imageStore(force_out, id, vec4(0.0));
+        return;
+    }
+
+    float a_mass = imageLoad(mass_a, a_id).x;
+    float b_mass = imageLoad(mass_b, b_id).x;
+
+    float force = G * a_mass * b_mass / dist2;
+
+    imageStore(force_out, id, vec4(normalize(pos_diff) * force, 0.0));
+}
+)";
+
+ForceComputeShader::ForceComputeShader() : base_t(code) {}
+
+void ForceComputeShader::set_chunk_a(ArrayBufferObject &positions, ArrayBufferObject &masses) {
+    set_buffer<glm::vec4>(positions, 0, GL_READ_ONLY);
+    set_buffer<GLfloat>(masses, 1, GL_READ_ONLY);
+}
+
+void ForceComputeShader::set_chunk_b(ArrayBufferObject &positions, ArrayBufferObject &masses) {
+    set_buffer<glm::vec4>(positions, 2, GL_READ_ONLY);
+    set_buffer<GLfloat>(masses, 3, GL_READ_ONLY);
+}
+
+void ForceComputeShader::set_force_out(ArrayBufferObject &vbo) { set_buffer<glm::vec4>(vbo, 4, GL_WRITE_ONLY); }
+
+void ForceComputeProgramConfig::set_G(GLfloat val) { program.set_uniform(0, val); }
+
+void ForceComputeProgramConfig::set_a_offset(GLint val) { program.set_uniform(1, val); }
+
+void ForceComputeProgramConfig::set_b_offset(GLint val) { program.set_uniform(2, val); }
+
+void ForceComputeProgramConfig::set_chunk_size(GLint val) { program.set_uniform(3, val); }
+
+const std::string TotalForceComputeShader::code = R"(
+#version 430 core
+
+layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+
+uniform layout(rgba32f, binding = 0) readonly imageBuffer force_in;
+// the same buffer when both chunks share a segment
+uniform layout(rgba32f, binding = 1) coherent imageBuffer force_a_out;
+uniform layout(rgba32f, binding = 2) coherent imageBuffer force_b_out;
+
+layout(location = 0) uniform int a_offset;
+layout(location = 1) uniform int b_offset;
+layout(location = 2) uniform int chunk_size;
+layout(location = 3) uniform bool diagonal;
+
+void main() {
+    int id = int(gl_GlobalInvocationID.x);
+
+    int a_id = a_offset + id;
+    int b_id = b_offset + id;
+
+    vec3 force_a = vec3(0.0);
+    vec3 force_b = vec3(0.0);
+
+    for(int i = 0; i < chunk_size; i++) {
+        force_a += imageLoad(force_in, i * chunk_size + id).xyz;
+        force_b += imageLoad(force_in, id * chunk_size + i).xyz;
+    }
+
+    vec3 force_a_prev = imageLoad(force_a_out, a_id).xyz;
+    imageStore(force_a_out, a_id, vec4(force_a_prev - force_a, 0.0));
+
+    // a block on the diagonal already holds both directions of every pair
+    if(diagonal) return;
+
+    vec3 force_b_prev = imageLoad(force_b_out, b_id).xyz;
+    imageStore(force_b_out, b_id, vec4(force_b_prev + force_b, 0.0));
+}
+)";
+
+TotalForceComputeShader::TotalForceComputeShader() : base_t(code) {}
+
+void TotalForceComputeShader::set_force_in(ArrayBufferObject &vbo) { set_buffer<glm::vec4>(vbo, 0, GL_READ_ONLY); }
+
+void TotalForceComputeShader::set_force_out(ArrayBufferObject &force_a, ArrayBufferObject &force_b) {
+    set_buffer<glm::vec4>(force_a, 1, GL_READ_WRITE);
+    set_buffer<glm::vec4>(force_b, 2, GL_READ_WRITE);
+}
+
+void TotalForceComputeProgramConfig::set_a_offset(GLint val) { program.set_uniform(0, val); }
+
+void TotalForceComputeProgramConfig::set_b_offset(GLint val) { program.set_uniform(1, val); }
+
+void TotalForceComputeProgramConfig::set_chunk_size(GLint val) { program.set_uniform(2, val); }
+
+void TotalForceComputeProgramConfig::set_diagonal(bool val) { program.set_uniform(3, GLint(val)); }
+
+const std::string UpdatePositionVelocityComputeShader::code  = R"(
+#version 430 core
+
+layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+
+uniform layout(rgba32f, binding = 0) readonly imageBuffer position_in;
+uniform layout(rgba32f, binding = 1) readonly imageBuffer velocity_in;
+uniform layout(r32f,    binding = 2) readonly imageBuffer mass_in;
+uniform layout(rgba32f, binding = 3) readonly imageBuffer force_in;
+uniform layout(rgba32f, binding = 4) writeonly imageBuffer position_out;
+uniform layout(rgba32f, binding = 5) writeonly imageBuffer velocity_out;
+
+layout(location = 0) uniform int offset;
+layout(location = 1) uniform float dt;
+
+void main() {
+    int id = offset + int(gl_GlobalInvocationID.x);
+
+    float mass = imageLoad(mass_in, id).x;
+    vec3 v_new = imageLoad(velocity_in, id).xyz;
+    if(mass > 0.0)
+        v_new += imageLoad(force_in, id).xyz / mass * dt;
+    vec3 p_new = imageLoad(position_in, id).xyz + v_new * dt;
+    imageStore(position_out, id, vec4(p_new, 1.0));
+    imageStore(velocity_out, id, vec4(v_new, 0.0));
+}
+)";
+
+UpdatePositionVelocityComputeShader::UpdatePositionVelocityComputeShader() : base_t(code) {}
+
+void UpdatePositionVelocityComputeShader::set_position_in(ArrayBufferObject &vbo) { set_buffer<glm::vec4>(vbo, 0, GL_READ_ONLY); }
+
+void UpdatePositionVelocityComputeShader::set_velocity_in(ArrayBufferObject &vbo) { set_buffer<glm::vec4>(vbo, 1, GL_READ_ONLY); }
+
+void UpdatePositionVelocityComputeShader::set_mass_in(ArrayBufferObject &vbo) { set_buffer<GLfloat>(vbo, 2, GL_READ_ONLY); }
+
+void UpdatePositionVelocityComputeShader::set_force_in(ArrayBufferObject &vbo) { set_buffer<glm::vec4>(vbo, 3, GL_READ_ONLY); }
+
+void UpdatePositionVelocityComputeShader::set_position_out(ArrayBufferObject &vbo) { set_buffer<glm::vec4>(vbo, 4, GL_WRITE_ONLY); }
+
+void UpdatePositionVelocityComputeShader::set_velocity_out(ArrayBufferObject &vbo) { set_buffer<glm::vec4>(vbo, 5, GL_WRITE_ONLY); }
+
+void UpdatePositionVelocityProgramConfig::set_offset(GLint val) { program.set_uniform(0, val); }
+
+void UpdatePositionVelocityProgramConfig::set_dt(GLfloat val) { program.set_uniform(1, val); }
+
+size_t query_free_device_memory() {
+    GLint extension_count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extension_count);
+    for(GLint i = 0; i < extension_count; ++i) {
+        std::string extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+        // both report KiB
+        if(extension == "GL_NVX_gpu_memory_info") {
+            GLint available = 0;
+            glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+            return size_t(std::max(available, 0)) << 10;
+        }
+        if(extension == "GL_ATI_meminfo") {
+            // free memory, largest free block, free auxiliary memory, largest auxiliary block
+            GLint info[4] = {};
+            glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, info);
+            return size_t(std::max(info[0], 0)) << 10;
+        }
+    }
+    return 0;
+}
+
+size_t chunked_gravity_block_memory() {
+    constexpr size_t fallback = 64 << 20;
+    auto free_memory = query_free_device_memory();
+    return free_memory ? std::max(free_memory / 4, fallback) : fallback;
+}
+
+size_t chunked_gravity_chunk_size(const ChunkedGravityConfig& config) {
+    constexpr size_t max_dispatch = 65535;
+    auto chunk = config.chunk_size;
+    if(chunk == 0) {
+        auto block_memory = config.block_memory ? config.block_memory : chunked_gravity_block_memory();
+        chunk = size_t(std::sqrt(double(block_memory / sizeof(glm::vec4))));
+    }
+    return std::clamp<size_t>(chunk, 1, max_dispatch);
+}
+
+ChunkedGravityGPU::ChunkedGravityGPU(ChunkedGravityConfig config)
+    : chunk_size(chunked_gravity_chunk_size(config)) {
+    // the block and every segment are one texture buffer each
+    GLint max_texels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    if(max_texels > 0)
+        chunk_size = std::min(chunk_size, size_t(std::sqrt(double(max_texels))));
+    segment_size = config.segment_size;
+    if(max_texels > 0 && (segment_size == 0 || segment_size > size_t(max_texels)))
+        segment_size = size_t(max_texels);
+    // whole chunks, at least one
+    segment_size = segment_size ? std::max<size_t>(segment_size / chunk_size, 1) * chunk_size : 0;
+    force_block.bind().init<glm::vec4>(chunk_size * chunk_size);
+}
+
+size_t ChunkedGravityGPU::get_chunk_size() const {
+    return chunk_size;
+}
+
+size_t ChunkedGravityGPU::get_segment_count() const {
+    return segments.size();
+}
+
+ChunkedGravityGPU::Segment& ChunkedGravityGPU::segment_of_chunk(size_t chunk) {
+    return segments[chunk * chunk_size / segments.front().size];
+}
+
+GLint ChunkedGravityGPU::local_offset(size_t chunk) const {
+    return GLint(chunk * chunk_size % segments.front().size);
+}
+
+void ChunkedGravityGPU::upload(const Bodies& bodies) {
+    auto count = bodies.get_count();
+    auto padded = std::max<size_t>(1, (count + chunk_size - 1) / chunk_size) * chunk_size;
+    if(padded != padded_count) {
+        padded_count = padded;
+        auto size = segment_size ? std::min(segment_size, padded_count) : padded_count;
+        segments.clear();
+        for(size_t offset = 0; offset < padded_count; offset += size) {
+            auto& segment = segments.emplace_back();
+            segment.offset = offset;
+            segment.size = std::min(size, padded_count - offset);
+            for(auto vbo : {&segment.positions, &segment.velocities, &segment.forces, &segment.positions_out, &segment.velocities_out})
+                vbo->bind().init<glm::vec4>(segment.size);
+            segment.masses.bind().init<float>(segment.size);
+        }
+    }
+
+    // massless padding exerts and feels no force
+    auto upload_range = [&](const Segment& segment, auto& source, auto& padded, auto& vbo) {
+        padded.assign(segment.size, {});
+        if(segment.offset < count)
+            std::copy_n(source.begin() + segment.offset, std::min(segment.size, count - segment.offset), padded.begin());
+        vbo.bind().update(padded);
+    };
+    for(auto& segment : segments) {
+        upload_range(segment, bodies.get_positions(), padded_vec4, segment.positions);
+        upload_range(segment, bodies.get_velocities(), padded_vec4, segment.velocities);
+        upload_range(segment, bodies.get_masses(), padded_float, segment.masses);
+    }
+}
+
+void ChunkedGravityGPU::calculate_forces(size_t bodies_count, float G) {
+    for(auto& segment : segments)
+        glClearNamedBufferData(buffer_name(segment.forces), GL_RGBA32F, GL_RGBA, GL_FLOAT, nullptr);
+    force_shader.set_force_out(force_block);
+    total_force_shader.set_force_in(force_block);
+    auto chunks = (bodies_count + chunk_size - 1) / chunk_size;
+    for(size_t a = 0; a < chunks; ++a) {
+        auto& segment_a = segment_of_chunk(a);
+        for(auto b = a; b < chunks; ++b) {
+            auto& segment_b = segment_of_chunk(b);
+            force_shader.set_chunk_a(segment_a.positions, segment_a.masses);
+            force_shader.set_chunk_b(segment_b.positions, segment_b.masses);
+            if(auto program = force_shader.use_program(); true) {
+                program.set_G(G);
+                program.set_a_offset(local_offset(a));
+                program.set_b_offset(local_offset(b));
+                program.set_chunk_size(GLint(chunk_size));
+                force_shader.dispatch(chunk_size, chunk_size, 1);
+            }
+            force_shader.barrier();
+            total_force_shader.set_force_out(segment_a.forces, segment_b.forces);
+            if(auto program = total_force_shader.use_program(); true) {
+                program.set_a_offset(local_offset(a));
+                program.set_b_offset(local_offset(b));
+                program.set_chunk_size(GLint(chunk_size));
+                program.set_diagonal(a == b);
+                total_force_shader.dispatch(chunk_size, 1, 1);
+            }
+            total_force_shader.barrier();
+        }
+    }
+}
+
+void ChunkedGravityGPU::step(size_t bodies_count, float G, float dt) {
+    calculate_forces(bodies_count, G);
+    for(auto& segment : segments) {
+        if(segment.offset >= bodies_count)
+            break;
+        update_shader.set_position_in(segment.positions);
+        update_shader.set_velocity_in(segment.velocities);
+        update_shader.set_mass_in(segment.masses);
+        update_shader.set_force_in(segment.forces);
+        update_shader.set_position_out(segment.positions_out);
+        update_shader.set_velocity_out(segment.velocities_out);
+        auto end = std::min(segment.size, bodies_count - segment.offset);
+        for(size_t offset = 0; offset < end; offset += chunk_size) {
+            if(auto program = update_shader.use_program(); true) {
+                program.set_offset(GLint(offset));
+                program.set_dt(dt);
+                update_shader.dispatch(chunk_size, 1, 1);
+            }
+        }
+    }
+    update_shader.barrier();
+}
+
+void ChunkedGravityGPU::download(Bodies& bodies) {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    auto count = bodies.get_count();
+    for(auto& segment : segments) {
+        if(segment.offset >= count)
+            break;
+        auto n = std::min(segment.size, count - segment.offset);
+        padded_vec4.resize(segment.size);
+        segment.positions_out.bind().download(padded_vec4, n);
+        std::copy_n(padded_vec4.begin(), n, bodies.get_positions().begin() + segment.offset);
+        segment.velocities_out.bind().download(padded_vec4, n);
+        std::copy_n(padded_vec4.begin(), n, bodies.get_velocities().begin() + segment.offset);
+    }
+}
+
+std::vector<glm::vec4> ChunkedGravityGPU::download_forces(size_t bodies_count) {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    std::vector<glm::vec4> forces(bodies_count);
+    for(auto& segment : segments) {
+        if(segment.offset >= bodies_count)
+            break;
+        auto n = std::min(segment.size, bodies_count - segment.offset);
+        padded_vec4.resize(segment.size);
+        segment.forces.bind().download(padded_vec4, n);
+        std::copy_n(padded_vec4.begin(), n, forces.begin() + segment.offset);
+    }
+    return forces;
+}
+
+void ChunkedGravityGPU::copy_positions_out(ArrayBufferObject& to, size_t bodies_count) {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    for(auto& segment : segments) {
+        if(segment.offset >= bodies_count)
+            break;
+        auto n = std::min(segment.size, bodies_count - segment.offset);
+        glCopyNamedBufferSubData(buffer_name(segment.positions_out),
+                                 buffer_name(to),
+                                 0,
+                                 GLintptr(segment.offset * sizeof(glm::vec4)),
+                                 GLsizeiptr(n * sizeof(glm::vec4)));
+    }
+}
@@ -1,306 +1,148 @@
 #pragma once
 
+#include <deque>
 #include <string>
-#include <ranges>
+#include <vector>
 
+#include "Bodies.hpp"
 #include "ComputeShaderBase.hpp"
 
-struct ForceComputeShader : ComputeShaderBase<3> {
-    static const std::string code;
-
-    ForceComputeShader() : ComputeShaderBase<3>(code) {}
-
-    void set_position_in(VertexBufferObject& vbo) { set_buffer<glm::vec4>(vbo, 0, GL_READ_ONLY); }
-    void set_mass_in(VertexBufferObject& vbo) { set_buffer<GLfloat>(vbo, 1, GL_READ_ONLY); }
-    void set_force_out(VertexBufferObject& vbo) { set_buffer<glm::vec4>(vbo, 2, GL_WRITE_ONLY); }
-
-    void set_G(GLfloat val) { program.set_uniform(0, val); }
-    void set_a_offset(GLint val) { program.set_uniform(1, val); }
-    void set_b_offset(GLint val) { program.set_uniform(2, val); }
-    void set_chunk_size(GLint val) { program.set_uniform(3, val); }
+// Chunked pairwise pipeline: the N x N force matrix is never stored whole.
+// ForceComputeShader fills one chunk x chunk block of pair forces,
+// TotalForceComputeShader folds the block into the per-body totals of both
+// chunks (Newton's third law, so only blocks with b_offset >= a_offset run)
+// and UpdatePositionVelocityComputeShader takes an Euler step from the totals,
+// one chunk per dispatch. Every dispatch and the scratch block are bounded by
+// the chunk size, only the per-body state grows with N. The two chunks of a
+// block are bound separately, so they can live in different buffers.
+
+struct ForceComputeProgramConfig {
+    ShaderProgram::InUse program;
+
+    void set_G(GLfloat val);
+    void set_a_offset(GLint val);
+    void set_b_offset(GLint val);
+    void set_chunk_size(GLint val);
 };
 
-const std::string ForceComputeShader::code = R"(
-#version 430 core
-
-layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
-
-uniform layout(rgba32f, binding = 0) readonly imageBuffer position_in;
-uniform layout(r32f, binding = 1) readonly imageBuffer mass_in;
-uniform layout(rgba32f, binding = 2) writeonly imageBuffer force_out;
-
-layout(location = 0) uniform float G;
-layout(location = 1) uniform int a_offset;
-layout(location = 2) uniform int b_offset;
-layout(location = 3) uniform int chunk_size;
-
-void main() {
-    int id = int(gl_GlobalInvocationID.x);
-    int row = id / chunk_size;
-    int col = id % chunk_size;
-
-    int a_id = a_offset + col;
-    int b_id = b_offset + row;
-
-    vec3 a_pos = imageLoad(position_in, a_id).xyz;
-    vec3 b_pos = imageLoad(position_in, b_id).xyz;
-
-    vec3 pos_diff = a_pos - b_pos;
-    float dist2 = pos_diff.x * pos_diff.x
-                + pos_diff.y * pos_diff.y
-                + pos_diff.z * pos_diff.z;
-
-    if(dist2 == 0.0f) {
-        imageStore(force_out, id, vec4(0.0, 0.0, 0.0, 0.0));
-        return;
-    }
-
-    float a_mass = imageLoad(mass_in, a_id).x;
-    float b_mass = imageLoad(mass_in, b_id).x;
-
-    float force = G * a_mass*b_mass / dist2;
-
-    vec3 force_vec = normalize(pos_diff) * force;
-
-    imageStore(force_out, id, vec4(force_vec, 0.0));
-}
-)";
-
-inline int test_force_compute_shader() {
-    VertexBufferObject vbo_pos, vbo_mass, vbo_force;
-    std::vector<glm::vec4> elements_pos {
-        {0.0f, 0.0f, 0.0f, 0.0f },
-        {1.0f, 0.0f, 0.0f, 0.0f },
-        {2.0f, 0.0f, 0.0f, 0.0f },
-        {5.0f, 0.0f, 0.0f, 0.0f }
-    };
-    vbo_pos.upload(elements_pos);
-
-    std::vector<float> elements_mass{ 1.0, 2.0, 3.0, 4.0 };
-    vbo_mass.upload(elements_mass);
-
-    std::vector<glm::vec4> elements_force;
-    std::fill_n(std::back_inserter(elements_force), 16, glm::vec4(0.0f));
-    vbo_force.upload(elements_force);
-
-    ForceComputeShader shader_program;
-    shader_program.set_position_in(vbo_pos);
-    shader_program.set_mass_in(vbo_mass);
-    shader_program.set_force_out(vbo_force);
-
-    shader_program.use_program();
-    shader_program.set_G(1.0f);
-    shader_program.set_a_offset(0);
-    shader_program.set_b_offset(0);
-    shader_program.set_chunk_size(4);
-
-    shader_program.dispatch(16, 1, 1);
-    shader_program.barrier();
-
-    std::vector<glm::vec4> elements_out(16);
-    vbo_force.download(elements_out);
-    for(auto [id, e] : elements_out | std::views::enumerate) {
-        std::cout << e.x << " ";// << e.y << " " << e.z << " " << e.a << "\n";
-        if(id % 4 == 3)
-            std::cout << std::endl;
-    }
-    std::cout << std::endl;
-
-    return 0;
-}
-
-struct TotalForceComputeShader : ComputeShaderBase<3> {
+// block[row * chunk_size + col]: force of body b_offset + row of chunk b on
+// body a_offset + col of chunk a, pointing from b to a. Dispatched as
+// chunk x chunk.
+struct ForceComputeShader : ComputeShaderBase<5, ForceComputeProgramConfig> {
+    using base_t = ComputeShaderBase<5, ForceComputeProgramConfig>;
     static const std::string code;
 
-    TotalForceComputeShader() : ComputeShaderBase<3>(code) {}
+    ForceComputeShader();
 
-    void set_force_in(VertexBufferObject& vbo) { set_buffer<glm::vec4>(vbo, 0, GL_READ_ONLY); }
-    void set_force_out(VertexBufferObject& vbo) { set_buffer<glm::vec4>(vbo, 1, GL_READ_WRITE); }
-
-    void set_a_offset(GLuint val) { program.set_uniform(0, val); }
-    void set_b_offset(GLuint val) { program.set_uniform(1, val); }
-    void set_chunk_size(GLuint val) { program.set_uniform(2, val); }
+    void set_chunk_a(ArrayBufferObject& positions, ArrayBufferObject& masses);
+    void set_chunk_b(ArrayBufferObject& positions, ArrayBufferObject& masses);
+    void set_force_out(ArrayBufferObject& vbo);
 };
 
-const std::string TotalForceComputeShader::code = R"(
-#version 430 core
-
-layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
-
-uniform layout(rgba32f, binding = 0) readonly imageBuffer force_in;
-uniform layout(rgba32f, binding = 1) imageBuffer force_out;
+struct TotalForceComputeProgramConfig {
+    ShaderProgram::InUse program;
 
-layout(location = 0) uniform int a_offset;
-layout(location = 1) uniform int b_offset;
-layout(location = 2) uniform int chunk_size;
-
-void main() {
-    int id = int(gl_GlobalInvocationID.x);
-
-    int a_id = a_offset + id;
-    int b_id = b_offset + id;
-
-    vec3 force_a = vec3(0.0);
-    vec3 force_b = vec3(0.0);
-
-    for(int i = 0; i < chunk_size; i++) {
-        force_a += imageLoad(force_in, i * chunk_size + id).xyz;
-        force_b += imageLoad(force_in, id * chunk_size + i).xyz;
-    }
-
-    vec3 force_a_prev = imageLoad(force_out, a_id).xyz;
-    imageStore(force_out, a_id, vec4(force_a_prev - force_a, 0.0));
-
-    if(a_id == b_id) return;
-
-    vec3 force_b_prev = imageLoad(force_out, b_id).xyz;
-    imageStore(force_out, b_id, vec4(force_b_prev + force_b, 0.0));
-}
-)";
-
-inline int test_total_force_compute_shader() {
-    VertexBufferObject vbo_forces_in, vbo_forces_out;
-    std::vector<glm::vec4> elements_force {
-        glm::vec4{1.0f}, glm::vec4{2.0f}, glm::vec4{3.0f}, glm::vec4{4.0f},
-        glm::vec4{5.0f}, glm::vec4{6.0f}, glm::vec4{7.0f}, glm::vec4{8.0f},
-        glm::vec4{9.0f}, glm::vec4{1.0f}, glm::vec4{2.0f}, glm::vec4{3.0f},
-        glm::vec4{4.0f}, glm::vec4{5.0f}, glm::vec4{6.0f}, glm::vec4{7.0f},
-    };
-    vbo_forces_in.upload(elements_force);
-    std::vector<glm::vec4> elements_force_current {
-        glm::vec4{100.0f},
-        glm::vec4{200.0f},
-        glm::vec4{300.0f},
-        glm::vec4{400.0f},
-        glm::vec4{-500.0f},
-        glm::vec4{-600.0f},
-        glm::vec4{-700.0f},
-        glm::vec4{-800.0f}
-    };
-    vbo_forces_out.upload(elements_force_current);
-
-    TotalForceComputeShader shader_program;
-    shader_program.use_program();
-    shader_program.set_force_in(vbo_forces_in);
-    shader_program.set_force_out(vbo_forces_out);
-
-    shader_program.set_a_offset(0);
-    shader_program.set_b_offset(4);
-    shader_program.set_chunk_size(4);
-
-    shader_program.dispatch(4, 1, 1);
-    shader_program.barrier();
-
-    std::vector<glm::vec4> elements_out(8);
-    vbo_forces_out.download(elements_out);
-    for(auto e : elements_out) {
-        std::cout << e.x /*<< " " << e.y << " " << e.z << " " << e.a*/ << "\n";
-    }
-    std::cout << std::endl;
-
-    return 0;
-}
+    void set_a_offset(GLint val);
+    void set_b_offset(GLint val);
+    void set_chunk_size(GLint val);
+    // both chunks are the same one
+    void set_diagonal(bool val);
+};
 
-struct UpdatePositionVelocityComputeShader : ComputeShaderBase<7> {
+// adds a block to the totals of both chunks, dispatched as chunk
+struct TotalForceComputeShader : ComputeShaderBase<3, TotalForceComputeProgramConfig> {
+    using base_t = ComputeShaderBase<3, TotalForceComputeProgramConfig>;
     static const std::string code;
 
-    UpdatePositionVelocityComputeShader() : ComputeShaderBase<7>(code) {}
+    TotalForceComputeShader();
 
-    void set_position_in(VertexBufferObject& vbo) { set_buffer<glm::vec4>(vbo, 0, GL_READ_ONLY); }
-    void set_velocity_in(VertexBufferObject& vbo) { set_buffer<glm::vec4>(vbo, 1, GL_READ_ONLY); }
-    void set_mass_in(VertexBufferObject& vbo) { set_buffer<GLfloat>(vbo, 2, GL_READ_ONLY); }
-    void set_force_in(VertexBufferObject& vbo) { set_buffer<glm::vec4>(vbo, 3, GL_READ_ONLY); }
-    void set_position_out(VertexBufferObject& vbo) { set_buffer<glm::vec4>(vbo, 4, GL_WRITE_ONLY); }
-    void set_velocity_out(VertexBufferObject& vbo) { set_buffer<glm::vec4>(vbo, 5, GL_WRITE_ONLY); }
+    void set_force_in(ArrayBufferObject& vbo);
+    void set_force_out(ArrayBufferObject& force_a, ArrayBufferObject& force_b);
 };
 
-const std::string UpdatePositionVelocityComputeShader::code  = R"(
-#version 430 core
+struct UpdatePositionVelocityProgramConfig {
+    ShaderProgram::InUse program;
 
-layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
+    void set_offset(GLint val);
+    void set_dt(GLfloat val);
+};
 
-uniform layout(rgba32f, binding = 0) readonly imageBuffer position_in;
-uniform layout(rgba32f, binding = 1) readonly imageBuffer velocity_in;
-uniform layout(r32f,    binding = 2) readonly imageBuffer mass_in;
-uniform layout(rgba32f, binding = 3) readonly imageBuffer force_in;
-uniform layout(rgba32f, binding = 4) writeonly imageBuffer position_out;
-uniform layout(rgba32f, binding = 5) writeonly imageBuffer velocity_out;
+// v += F / m dt, x += v dt for bodies [offset, offset + dispatch size),
+// massless bodies keep their velocity
+struct UpdatePositionVelocityComputeShader : ComputeShaderBase<6, UpdatePositionVelocityProgramConfig> {
+    using base_t = ComputeShaderBase<6, UpdatePositionVelocityProgramConfig>;
+    static const std::string code;
 
-void main() {
-    int id = int(gl_GlobalInvocationID.x);
+    UpdatePositionVelocityComputeShader();
 
-    vec3 delta_v = imageLoad(force_in, id).xyz / imageLoad(mass_in, id).x;
-    vec3 v_new = imageLoad(velocity_in, id).xyz + delta_v;
-    vec3 p_new = imageLoad(position_in, id).xyz + v_new;
-    imageStore(position_out, id, vec4(p_new, 0.0));
-    imageStore(velocity_out, id, vec4(v_new, 0.0));
-}
-)";
+    void set_position_in(ArrayBufferObject& vbo);
+    void set_velocity_in(ArrayBufferObject& vbo);
+    void set_mass_in(ArrayBufferObject& vbo);
+    void set_force_in(ArrayBufferObject& vbo);
+    void set_position_out(ArrayBufferObject& vbo);
+    void set_velocity_out(ArrayBufferObject& vbo);
+};
 
-inline int test_update_position_velocity_shader() {
-    VertexBufferObject vbo_position_in,
-                       vbo_velocity_in,
-                       vbo_mass_in,
-                       vbo_force_in,
-                       vbo_position_out,
-                       vbo_velocity_out;
+struct ChunkedGravityConfig {
+    // device memory for the pair block, sets the chunk size; 0 takes a
+    // quarter of the free memory the driver reports
+    size_t block_memory = 0;
+    // overrides block_memory when not 0
+    size_t chunk_size = 0;
+    // most bodies per buffer of the per-body state, 0 takes what one
+    // texture buffer holds (GL_MAX_TEXTURE_BUFFER_SIZE)
+    size_t segment_size = 0;
+};
 
-    std::vector<glm::vec4> elements_position {
-        glm::vec4(1.0),
-        glm::vec4(2.0),
-        glm::vec4(3.0),
-        glm::vec4(4.0),
-    };
-    vbo_position_in.upload(elements_position);
-    std::vector<glm::vec4> elements_velocity {
-        glm::vec4(5.0),
-        glm::vec4(6.0),
-        glm::vec4(7.0),
-        glm::vec4(8.0),
+// Free device memory in bytes from GL_NVX_gpu_memory_info or
+// GL_ATI_meminfo, 0 when the driver offers neither.
+size_t query_free_device_memory();
+
+// the block memory to use when config.block_memory is 0, 64 MiB when the
+// driver cannot tell
+size_t chunked_gravity_block_memory();
+
+// largest chunk whose block fits, within what one dispatch dimension takes
+size_t chunked_gravity_chunk_size(const ChunkedGravityConfig& config);
+
+// The pipeline above on device-resident state. The state is padded to whole
+// chunks with massless bodies, and split into segments of whole chunks that
+// each fit in a texture buffer.
+class ChunkedGravityGPU {
+    // bodies [offset, offset + size) of the padded state
+    struct Segment {
+        size_t offset = 0;
+        size_t size = 0;
+        ArrayBufferObject positions, velocities, masses, forces, positions_out, velocities_out;
     };
-    vbo_velocity_in.upload(elements_velocity);
-    std::vector<float> elements_mass {
-        1.0f,
-        2.0f,
-        3.0f,
-        4.0f,
-    };
-    vbo_mass_in.upload(elements_mass);
-    std::vector<glm::vec4> elements_force {
-        glm::vec4(1.0),
-        glm::vec4(2.0),
-        glm::vec4(3.0),
-        glm::vec4(4.0),
-    };
-    vbo_force_in.upload(elements_force);
-
-    std::vector<glm::vec4> elements_out;
-    std::fill_n(std::back_inserter(elements_out), 4, glm::vec4(0.0f));
-    vbo_position_out.upload(elements_out);
-    vbo_velocity_out.upload(elements_out);
-
-    UpdatePositionVelocityComputeShader shader_program;
-    shader_program.use_program();
-    shader_program.set_position_in(vbo_position_in);
-    shader_program.set_position_in(vbo_velocity_in);
-    shader_program.set_position_in(vbo_mass_in);
-    shader_program.set_position_in(vbo_force_in);
-    shader_program.set_position_in(vbo_position_out);
-    shader_program.set_position_in(vbo_velocity_out);
 
-    shader_program.dispatch(4, 1, 1);
-    shader_program.barrier();
-
-    std::cout << "Positions:" << std::endl;
-    vbo_position_out.download(elements_out);
-    for(auto e : elements_out) {
-        std::cout << e.x << " " << e.y << " " << e.z << " " << e.a << "\n";
-    }
-    std::cout << "Velocities:" << std::endl;
-    vbo_velocity_out.download(elements_out);
-    for(auto e : elements_out) {
-        std::cout << e.x << " " << e.y << " " << e.z << " " << e.a << "\n";
-    }
-
-    return 0;
-}
+    size_t chunk_size;
+    size_t segment_size;
+    size_t padded_count = 0;
+    std::deque<Segment> segments;
+    ArrayBufferObject force_block;
+    ForceComputeShader force_shader;
+    TotalForceComputeShader total_force_shader;
+    UpdatePositionVelocityComputeShader update_shader;
+    std::vector<glm::vec4> padded_vec4;
+    std::vector<float> padded_float;
+
+    Segment& segment_of_chunk(size_t chunk);
+    // offset of the chunk in its segment
+    GLint local_offset(size_t chunk) const;
+public:
+    explicit ChunkedGravityGPU(ChunkedGravityConfig config = {});
+
+    size_t get_chunk_size() const;
+    size_t get_segment_count() const;
+    void upload(const Bodies& bodies);
+    // total force on each of the first bodies_count bodies
+    void calculate_forces(size_t bodies_count, float G);
+    // forces, then an Euler step into the output buffers
+    void step(size_t bodies_count, float G, float dt);
+    void download(Bodies& bodies);
+    std::vector<glm::vec4> download_forces(size_t bodies_count);
+    // device-side copy of the stepped positions of the first bodies_count
+    // bodies into one buffer
+    void copy_positions_out(ArrayBufferObject& to, size_t bodies_count);
+};
@@ -1,5 +1,7 @@
 #include "GravityComputeShader.hpp"
 
+#include <algorithm>
+
 const std::string GravityComputeShader::code  = R"(
 #version 430 core
 
@@ -8,57 +10,134 @@ layout (local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
 uniform layout(rgba32f, binding = 0) readonly imageBuffer position_in;
 uniform layout(rgba32f, binding = 1) readonly imageBuffer velocity_in;
 uniform layout(r32f,    binding = 2) readonly imageBuffer mass_in;
-uniform layout(rgba32f, binding = 3) writeonly imageBuffer position_out;
-uniform layout(rgba32f, binding = 4) writeonly imageBuffer velocity_out;
+uniform layout(rgba32f, binding = 3) coherent imageBuffer position_out;
+uniform layout(rgba32f, binding = 4) coherent imageBuffer velocity_out;
+uniform layout(rgba32f, binding = 5) coherent imageBuffer derivatives;
+uniform layout(rgba32f, binding = 6) coherent imageBuffer predicted_position;
+uniform layout(rgba32f, binding = 7) coherent imageBuffer predicted_velocity;
 
 layout(location = 0) uniform int elements_count;
 layout(location = 1) uniform float G;
+layout(location = 2) uniform float dt;
+layout(location = 3) uniform int scheme;
+layout(location = 4) uniform int stage;
+
+const int SCHEME_EULER = 0;
+const int SCHEME_LEAPFROG = 1;
+const int SCHEME_HERMITE = 2;
+
+const int STAGE_INIT = 0;
+const int STAGE_ADVANCE = 1;
+const int STAGE_FINISH = 2;
 
-vec3 calc_force(vec3 pos_a, vec3 vel_a, float mass_a,
-                vec3 pos_b, vec3 vec_b, float mass_b);
+const int SOURCE_IN = 0;
+const int SOURCE_OUT = 1;
+const int SOURCE_PREDICTED = 2;
 
-vec3 calc_force(vec3 pos_a, vec3 vel_a, float mass_a,
-                vec3 pos_b, vec3 vec_b, float mass_b) {
-        vec3 pos_diff = pos_b - pos_a;
-        float dist2 = pos_diff.x * pos_diff.x
-                    + pos_diff.y * pos_diff.y
-                    + pos_diff.z * pos_diff.z;
+vec3 load_position(int id, int source) {
+    if(source == SOURCE_OUT)
+        return imageLoad(position_out, id).xyz;
+    if(source == SOURCE_PREDICTED)
+        return imageLoad(predicted_position, id).xyz;
+    return imageLoad(position_in, id).xyz;
+}
+
+vec3 load_velocity(int id, int source) {
+    if(source == SOURCE_OUT)
+        return imageLoad(velocity_out, id).xyz;
+    if(source == SOURCE_PREDICTED)
+        return imageLoad(predicted_velocity, id).xyz;
+    return imageLoad(velocity_in, id).xyz;
+}
 
-        if(dist2 == 0.0f) {
-            return vec3(0.0);
+// acceleration and, for Hermite, jerk of body id from the source state
+void evaluate(int id, int source, out vec3 acc, out vec3 jerk) {
+    vec3 pos = load_position(id, source);
+    vec3 vel = load_velocity(id, source);
+    acc = vec3(0.0);
+    jerk = vec3(0.0);
+
+    for(int i = 0; i < elements_count; ++i) {
+        if(i == id)
+            continue;
+        vec3 r = load_position(i, source) - pos;
+        float r2 = dot(r, r);
+        if(r2 == 0.0f)
+            continue;
+        float inv_r = inversesqrt(r2);
+        float inv_r2 = inv_r * inv_r;
+        float m_inv_r3 = imageLoad(mass_in, i).x * inv_r * inv_r2;
+        acc += r * m_inv_r3;
+        if(scheme == SCHEME_HERMITE) {
+            vec3 v = load_velocity(i, source) - vel;
+            jerk += (v - r * (3.0 * dot(r, v) * inv_r2)) * m_inv_r3;
         }
-        float force = G * mass_a * mass_b / dist2;
-        return normalize(pos_diff) * force;
+    }
+    acc *= G;
+    jerk *= G;
+}
+
+void store_derivatives(int id, vec3 acc, vec3 jerk) {
+    imageStore(derivatives, 2 * id, vec4(acc, 0.0));
+    imageStore(derivatives, 2 * id + 1, vec4(jerk, 0.0));
 }
 
 void main() {
     int id = int(gl_GlobalInvocationID.x);
-
-    vec3 force = vec3(0.0);
+    if(id >= elements_count)
+        return;
 
     vec3 pos = imageLoad(position_in, id).xyz;
     vec3 vel = imageLoad(velocity_in, id).xyz;
-    float mass = imageLoad(mass_in, id).x;
-
-    int i;
-    for(i = 0; i < id; ++i) {
-        vec3 pos_ = imageLoad(position_in, i).xyz;
-        vec3 vel_ = imageLoad(velocity_in, i).xyz;
-        float mass_ = imageLoad(mass_in, i).x;
-        force += calc_force(pos, vel, mass, pos_, vel_, mass_);
+    vec3 acc;
+    vec3 jerk;
+
+    if(stage == STAGE_INIT) {
+        evaluate(id, SOURCE_IN, acc, jerk);
+        store_derivatives(id, acc, jerk);
+        return;
     }
-    for(i = id + 1; i < elements_count; ++i) {
-        vec3 pos_ = imageLoad(position_in, i).xyz;
-        vec3 vel_ = imageLoad(velocity_in, i).xyz;
-        float mass_ = imageLoad(mass_in, i).x;
-        force += calc_force(pos, vel, mass, pos_, vel_, mass_);
+
+    if(scheme == SCHEME_EULER) {
+        evaluate(id, SOURCE_IN, acc, jerk);
+        vec3 vel_new = vel + acc * dt;
+        imageStore(position_out, id, vec4(pos + vel_new * dt, 1.0));
+        imageStore(velocity_out, id, vec4(vel_new, 0.0));
+        return;
     }
 
-    vec3 vel_new = vel + force / mass;
-    vec3 pos_new = pos + vel_new;
+    vec3 acc_old = imageLoad(derivatives, 2 * id).xyz;
+    vec3 jerk_old = imageLoad(derivatives, 2 * id + 1).xyz;
+
+    if(scheme == SCHEME_LEAPFROG) {
+        if(stage == STAGE_ADVANCE) {
+            vec3 vel_half = vel + acc_old * (dt / 2.0);
+            imageStore(position_out, id, vec4(pos + vel_half * dt, 1.0));
+            imageStore(velocity_out, id, vec4(vel_half, 0.0));
+        } else {
+            evaluate(id, SOURCE_OUT, acc, jerk);
+            vec3 vel_half = imageLoad(velocity_out, id).xyz;
+            imageStore(velocity_out, id, vec4(vel_half + acc * (dt / 2.0), 0.0));
+            store_derivatives(id, acc, jerk);
+        }
+        return;
+    }
 
-    imageStore(position_out, id, vec4(pos_new, 0.0));
-    imageStore(velocity_out, id, vec4(vel_new, 0.0));
+    if(stage == STAGE_ADVANCE) {
+        float dt2 = dt * dt;
+        vec3 pos_pred = pos + vel * dt + acc_old * (dt2 / 2.0) + jerk_old * (dt2 * dt / 6.0);
+        vec3 vel_pred = vel + acc_old * dt + jerk_old * (dt2 / 2.0);
+        imageStore(predicted_position, id, vec4(pos_pred, 1.0));
+        imageStore(predicted_velocity, id, vec4(vel_pred, 0.0));
+    } else {
+        float dt2 = dt * dt;
+        evaluate(id, SOURCE_PREDICTED, acc, jerk);
+        vec3 vel_new = vel + (acc_old + acc) * (dt / 2.0) + (jerk_old - jerk) * (dt2 / 12.0);
+        vec3 pos_new = pos + (vel + vel_new) * (dt / 2.0) + (acc_old - acc) * (dt2 / 12.0);
+        imageStore(position_out, id, vec4(pos_new, 1.0));
+        imageStore(velocity_out, id, vec4(vel_new, 0.0));
+        store_derivatives(id, acc, jerk);
+    }
 }
 )";
 
@@ -77,13 +156,236 @@ void GravityComputeShader::set_mass_in(ArrayBufferObject &vbo) {
 }
 
 void GravityComputeShader::set_position_out(ArrayBufferObject &vbo) {
-    set_buffer<glm::vec4>(vbo, 3, GL_WRITE_ONLY);
+    set_buffer<glm::vec4>(vbo, 3, GL_READ_WRITE);
 }
 
 void GravityComputeShader::set_velocity_out(ArrayBufferObject &vbo) {
-    set_buffer<glm::vec4>(vbo, 4, GL_WRITE_ONLY);
+    set_buffer<glm::vec4>(vbo, 4, GL_READ_WRITE);
+}
+
+void GravityComputeShader::set_derivatives(ArrayBufferObject &vbo) {
+    set_buffer<glm::vec4>(vbo, 5, GL_READ_WRITE);
+}
+
+void GravityComputeShader::set_predicted_position(ArrayBufferObject &vbo) {
+    set_buffer<glm::vec4>(vbo, 6, GL_READ_WRITE);
+}
+
+void GravityComputeShader::set_predicted_velocity(ArrayBufferObject &vbo) {
+    set_buffer<glm::vec4>(vbo, 7, GL_READ_WRITE);
 }
 
 void GravityComputeProgramConfig::set_elements_count(GLint val) { program.set_uniform(0, val); }
 
 void GravityComputeProgramConfig::set_G(GLfloat val) { program.set_uniform(1, val); }
+
+void GravityComputeProgramConfig::set_dt(GLfloat val) { program.set_uniform(2, val); }
+
+void GravityComputeProgramConfig::set_scheme(GLint val) { program.set_uniform(3, val); }
+
+void GravityComputeProgramConfig::set_stage(GravityShaderStage val) { program.set_uniform(4, (GLint)val); }
+
+// the #version line and LOCAL_SIZE are prepended by the constructor
+const std::string TiledGravityComputeShader::code = R"(
+layout (local_size_x = LOCAL_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+layout(std430, binding = 0) readonly buffer PositionIn { vec4 position_in[]; };
+layout(std430, binding = 1) readonly buffer VelocityIn { vec4 velocity_in[]; };
+layout(std430, binding = 2) readonly buffer MassIn { float mass_in[]; };
+layout(std430, binding = 3) coherent buffer PositionOut { vec4 position_out[]; };
+layout(std430, binding = 4) coherent buffer VelocityOut { vec4 velocity_out[]; };
+layout(std430, binding = 5) coherent buffer Derivatives { vec4 derivatives[]; };
+layout(std430, binding = 6) coherent buffer PredictedPosition { vec4 predicted_position[]; };
+layout(std430, binding = 7) coherent buffer PredictedVelocity { vec4 predicted_velocity[]; };
+
+layout(location = 0) uniform int elements_count;
+layout(location = 1) uniform float G;
+layout(location = 2) uniform float dt;
+layout(location = 3) uniform int scheme;
+layout(location = 4) uniform int stage;
+
+const int SCHEME_EULER = 0;
+const int SCHEME_LEAPFROG = 1;
+const int SCHEME_HERMITE = 2;
+
+const int STAGE_INIT = 0;
+const int STAGE_ADVANCE = 1;
+const int STAGE_FINISH = 2;
+
+const int SOURCE_IN = 0;
+const int SOURCE_OUT = 1;
+const int SOURCE_PREDICTED = 2;
+
+// xyz position, w mass
+shared vec4 tile_body[LOCAL_SIZE];
+shared vec3 tile_velocity[LOCAL_SIZE];
+
+vec3 load_position(int id, int source) {
+    if(source == SOURCE_OUT)
+        return position_out[id].xyz;
+    if(source == SOURCE_PREDICTED)
+        return predicted_position[id].xyz;
+    return position_in[id].xyz;
+}
+
+vec3 load_velocity(int id, int source) {
+    if(source == SOURCE_OUT)
+        return velocity_out[id].xyz;
+    if(source == SOURCE_PREDICTED)
+        return predicted_velocity[id].xyz;
+    return velocity_in[id].xyz;
+}
+
+// acceleration and, for Hermite, jerk of body id from the source state. All
+// invocations of the workgroup take part in loading the tiles, including
+// those past the last body.
+void evaluate(int id, int source, out vec3 acc, out vec3 jerk) {
+    vec3 pos = load_position(id, source);
+    vec3 vel = scheme == SCHEME_HERMITE ? load_velocity(id, source) : vec3(0.0);
+    acc = vec3(0.0);
+    jerk = vec3(0.0);
+
+    int local_id = int(gl_LocalInvocationID.x);
+    for(int tile = 0; tile < elements_count; tile += LOCAL_SIZE) {
+        int j = tile + local_id;
+        if(j < elements_count) {
+            tile_body[local_id] = vec4(load_position(j, source), mass_in[j]);
+            if(scheme == SCHEME_HERMITE)
+                tile_velocity[local_id] = load_velocity(j, source);
+        }
+        barrier();
+
+        int tile_count = min(LOCAL_SIZE, elements_count - tile);
+        for(int k = 0; k < tile_count; ++k) {
+            vec3 r = tile_body[k].xyz - pos;
+            float r2 = dot(r, r);
+            // also skips the body itself
+            if(r2 == 0.0f)
+                continue;
+            float inv_r = inversesqrt(r2);
+            float inv_r2 = inv_r * inv_r;
+            float m_inv_r3 = tile_body[k].w * inv_r * inv_r2;
+            acc += r * m_inv_r3;
+            if(scheme == SCHEME_HERMITE) {
+                vec3 v = tile_velocity[k] - vel;
+                jerk += (v - r * (3.0 * dot(r, v) * inv_r2)) * m_inv_r3;
+            }
+        }
+        barrier();
+    }
+    acc *= G;
+    jerk *= G;
+}
+
+void store_derivatives(int id, vec3 acc, vec3 jerk) {
+    derivatives[2 * id] = vec4(acc, 0.0);
+    derivatives[2 * id + 1] = vec4(jerk, 0.0);
+}
+
+void main() {
+    int global_id = int(gl_GlobalInvocationID.x);
+    bool in_range = global_id < elements_count;
+    // invocations out of range still help load tiles, on behalf of body 0
+    int id = in_range ? global_id : 0;
+
+    vec3 pos = position_in[id].xyz;
+    vec3 vel = velocity_in[id].xyz;
+    vec3 acc;
+    vec3 jerk;
+
+    if(stage == STAGE_INIT) {
+        evaluate(id, SOURCE_IN, acc, jerk);
+        if(in_range)
+            store_derivatives(id, acc, jerk);
+        return;
+    }
+
+    if(scheme == SCHEME_EULER) {
+        evaluate(id, SOURCE_IN, acc, jerk);
+        vec3 vel_new = vel + acc * dt;
+        if(in_range) {
+            position_out[id] = vec4(pos + vel_new * dt, 1.0);
+            velocity_out[id] = vec4(vel_new, 0.0);
+        }
+        return;
+    }
+
+    vec3 acc_old = derivatives[2 * id].xyz;
+    vec3 jerk_old = derivatives[2 * id + 1].xyz;
+
+    if(scheme == SCHEME_LEAPFROG) {
+        if(stage == STAGE_ADVANCE) {
+            vec3 vel_half = vel + acc_old * (dt / 2.0);
+            if(in_range) {
+                position_out[id] = vec4(pos + vel_half * dt, 1.0);
+                velocity_out[id] = vec4(vel_half, 0.0);
+            }
+        } else {
+            evaluate(id, SOURCE_OUT, acc, jerk);
+            vec3 vel_half = velocity_out[id].xyz;
+            if(in_range) {
+                velocity_out[id] = vec4(vel_half + acc * (dt / 2.0), 0.0);
+                store_derivatives(id, acc, jerk);
+            }
+        }
+        return;
+    }
+
+    if(stage == STAGE_ADVANCE) {
+        float dt2 = dt * dt;
+        vec3 pos_pred = pos + vel * dt + acc_old * (dt2 / 2.0) + jerk_old * (dt2 * dt / 6.0);
+        vec3 vel_pred = vel + acc_old * dt + jerk_old * (dt2 / 2.0);
+        if(in_range) {
+            predicted_position[id] = vec4(pos_pred, 1.0);
+            predicted_velocity[id] = vec4(vel_pred, 0.0);
+        }
+    } else {
+        float dt2 = dt * dt;
+        evaluate(id, SOURCE_PREDICTED, acc, jerk);
+        vec3 vel_new = vel + (acc_old + acc) * (dt / 2.0) + (jerk_old - jerk) * (dt2 / 12.0);
+        vec3 pos_new = pos + (vel + vel_new) * (dt / 2.0) + (acc_old - acc) * (dt2 / 12.0);
+        if(in_range) {
+            position_out[id] = vec4(pos_new, 1.0);
+            velocity_out[id] = vec4(vel_new, 0.0);
+            store_derivatives(id, acc, jerk);
+        }
+    }
+}
+)";
+
+TiledGravityComputeShader::TiledGravityComputeShader(GLuint local_size)
+    : local_size(std::clamp<GLuint>(local_size, 1, max_local_size))
+    , program(Shader("#version 430 core\n#define LOCAL_SIZE " + std::to_string(this->local_size) + "\n" + code,
+                     GL_COMPUTE_SHADER)) {}
+
+GravityComputeProgramConfig TiledGravityComputeShader::use_program() {
+    return {program.use()};
+}
+
+void TiledGravityComputeShader::set_position_in(ArrayBufferObject &vbo) { buffers[0] = &vbo; }
+
+void TiledGravityComputeShader::set_velocity_in(ArrayBufferObject &vbo) { buffers[1] = &vbo; }
+
+void TiledGravityComputeShader::set_mass_in(ArrayBufferObject &vbo) { buffers[2] = &vbo; }
+
+void TiledGravityComputeShader::set_position_out(ArrayBufferObject &vbo) { buffers[3] = &vbo; }
+
+void TiledGravityComputeShader::set_velocity_out(ArrayBufferObject &vbo) { buffers[4] = &vbo; }
+
+void TiledGravityComputeShader::set_derivatives(ArrayBufferObject &vbo) { buffers[5] = &vbo; }
+
+void TiledGravityComputeShader::set_predicted_position(ArrayBufferObject &vbo) { buffers[6] = &vbo; }
+
+void TiledGravityComputeShader::set_predicted_velocity(ArrayBufferObject &vbo) { buffers[7] = &vbo; }
+
+void TiledGravityComputeShader::dispatch(size_t bodies_count) {
+    for(GLuint binding = 0; binding < buffers.size(); ++binding) {
+        if(buffers[binding])
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, buffer_name(*buffers[binding]));
+    }
+    glDispatchCompute(GLuint((bodies_count + local_size - 1) / local_size), 1, 1);
+}
+
+void TiledGravityComputeShader::barrier() {
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
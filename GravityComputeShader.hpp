@@ -2,17 +2,29 @@
 
 #include "ComputeShaderBase.hpp"
 
-//
+// Passes of one integration step, each dispatch sees the previous one's
+// results. Euler only runs Advance. Leapfrog runs Init (when the stored
+// accelerations are stale), Advance (kick + drift) and Finish (kick with the
+// new accelerations). Hermite runs Init, Advance (predict) and Finish
+// (evaluate at the prediction + correct).
+enum class GravityShaderStage : GLint {
+    Init = 0,
+    Advance = 1,
+    Finish = 2
+};
 
 struct GravityComputeProgramConfig {
     ShaderProgram::InUse program;
 
     void set_elements_count(GLint val);
     void set_G(GLfloat val);
+    void set_dt(GLfloat val);
+    void set_scheme(GLint val);
+    void set_stage(GravityShaderStage val);
 };
 
-struct GravityComputeShader : ComputeShaderBase<5, GravityComputeProgramConfig>{
-    using base_t = ComputeShaderBase<5, GravityComputeProgramConfig>;
+struct GravityComputeShader : ComputeShaderBase<8, GravityComputeProgramConfig>{
+    using base_t = ComputeShaderBase<8, GravityComputeProgramConfig>;
     static const std::string code;
 
 
@@ -23,5 +35,38 @@ struct GravityComputeShader : ComputeShaderBase<5, GravityComputeProgramConfig>{
     void set_mass_in(ArrayBufferObject& vbo);
     void set_position_out(ArrayBufferObject& vbo);
     void set_velocity_out(ArrayBufferObject& vbo);
+    // two texels per body: acceleration, jerk
+    void set_derivatives(ArrayBufferObject& vbo);
+    void set_predicted_position(ArrayBufferObject& vbo);
+    void set_predicted_velocity(ArrayBufferObject& vbo);
+
+};
+
+// Same stages, uniforms and bindings as GravityComputeShader, with the state
+// in shader storage buffers. Every workgroup stages the sources one tile of
+// local_size bodies at a time in shared memory: position and mass, plus the
+// velocity for Hermite, so the inner loop reads no global memory.
+struct TiledGravityComputeShader {
+    static const std::string code;
+    static constexpr GLuint max_local_size = 1024;
+
+    GLuint local_size;
+    ShaderProgram program;
+    std::array<ArrayBufferObject*, 8> buffers{};
 
+    // local_size is clamped to [1, max_local_size]
+    explicit TiledGravityComputeShader(GLuint local_size);
+
+    GravityComputeProgramConfig use_program();
+    void set_position_in(ArrayBufferObject& vbo);
+    void set_velocity_in(ArrayBufferObject& vbo);
+    void set_mass_in(ArrayBufferObject& vbo);
+    void set_position_out(ArrayBufferObject& vbo);
+    void set_velocity_out(ArrayBufferObject& vbo);
+    void set_derivatives(ArrayBufferObject& vbo);
+    void set_predicted_position(ArrayBufferObject& vbo);
+    void set_predicted_velocity(ArrayBufferObject& vbo);
+    // ceil(bodies_count / local_size) workgroups
+    void dispatch(size_t bodies_count);
+    void barrier();
 };
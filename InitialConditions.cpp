@@ -0,0 +1,122 @@
+#include "InitialConditions.hpp"
+
+#include <cmath>
+#include <glm/gtx/transform.hpp>
+
+namespace {
+// splitmix64 finalizer
+uint64_t mix(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+constexpr uint64_t golden = 0x9e3779b97f4a7c15ull;
+}
+
+CounterRng::CounterRng(uint64_t seed, uint64_t stream)
+    : key(mix(seed ^ mix(stream + golden))) {}
+
+uint64_t CounterRng::next() {
+    return mix(key + ++counter * golden);
+}
+
+float CounterRng::uniform() {
+    return float(next() >> 40) * 0x1.0p-24f;
+}
+
+float CounterRng::uniform_open() {
+    return (float(next() >> 41) + 0.5f) * 0x1.0p-23f;
+}
+
+float CounterRng::uniform_signed() {
+    return uniform() * 2.0f - 1.0f;
+}
+
+glm::vec3 CounterRng::unit_vector() {
+    auto z = uniform_signed();
+    auto phi = uniform() * 2.0f * M_PIf;
+    auto s = std::sqrt(1.0f - z * z);
+    return {s * std::cos(phi), s * std::sin(phi), z};
+}
+
+void generate_rotating_disk(Bodies& bodies, const InitialConditionsConfig& config, ThreadPool& pool) {
+    glm::vec3 z_axis{0.0f, 0.0f, 1.0f};
+    auto first = bodies.get_count();
+    bodies.reserve(first + config.count);
+    bodies.append(config.count, pool, [&](size_t k) {
+        CounterRng rng(config.seed, first + k);
+        auto dist = std::sqrt(rng.uniform());
+        auto angle = rng.uniform_signed() * M_PIf;
+
+        glm::vec4 position = glm::rotate(angle, z_axis) * glm::vec4{dist, 0.0f, 0.0f, 1.0f};
+
+        glm::vec4 velocity{position.y, -position.x, rng.uniform_signed() / 5.0f, 0.0f};
+        velocity *= dist / 2000.0f;
+        position = glm::vec4(glm::vec3(position) * config.scale, 1.0f);
+        return BodyState{position, velocity, rng.uniform() / 4.1f};
+    });
+}
+
+void generate_plummer(Bodies& bodies, const InitialConditionsConfig& config, ThreadPool& pool) {
+    auto a = config.scale;
+    auto total_mass = config.body_mass * float(config.count);
+    auto first = bodies.get_count();
+    bodies.reserve(first + config.count);
+    bodies.append(config.count, pool, [&](size_t k) {
+        CounterRng rng(config.seed, first + k);
+        // inverse of the cumulative mass M(<r) = M r^3 / (r^2 + a^2)^(3/2)
+        float r;
+        do {
+            r = a / std::sqrt(std::pow(rng.uniform_open(), -2.0f / 3.0f) - 1.0f);
+        } while(r > 10.0f * a);
+
+        // speed as a fraction q of the escape speed, g(q) = q^2 (1 - q^2)^3.5 < 0.1
+        float q;
+        do {
+            q = rng.uniform();
+        } while(rng.uniform() * 0.1f > q * q * std::pow(1.0f - q * q, 3.5f));
+        auto v_escape = std::sqrt(2.0f * config.G * total_mass) * std::pow(r * r + a * a, -0.25f);
+
+        glm::vec4 position(rng.unit_vector() * r, 1.0f);
+        glm::vec4 velocity(rng.unit_vector() * (q * v_escape), 0.0f);
+        return BodyState{position, velocity, config.body_mass};
+    });
+}
+
+void generate_exponential_disk(Bodies& bodies, const InitialConditionsConfig& config, ThreadPool& pool) {
+    auto rd = config.scale;
+    auto z0 = 0.1f * rd;
+    auto total_mass = config.body_mass * float(config.count);
+    auto first = bodies.get_count();
+    bodies.reserve(first + config.count);
+    bodies.append(config.count, pool, [&](size_t k) {
+        CounterRng rng(config.seed, first + k);
+        // the exponential surface density e^(-R/Rd) makes the radial pdf
+        // R e^(-R/Rd), a gamma(2) distribution
+        float r;
+        do {
+            r = -rd * std::log(rng.uniform_open() * rng.uniform_open());
+        } while(r > 10.0f * rd);
+        auto z = z0 * std::atanh(2.0f * rng.uniform_open() - 1.0f);
+        auto phi = rng.uniform() * 2.0f * M_PIf;
+
+        auto enclosed = total_mass * (1.0f - (1.0f + r / rd) * std::exp(-r / rd));
+        auto v_circular = std::sqrt(config.G * enclosed / r);
+
+        glm::vec4 position{r * std::cos(phi), r * std::sin(phi), z, 1.0f};
+        glm::vec4 velocity{-v_circular * std::sin(phi), v_circular * std::cos(phi), 0.0f, 0.0f};
+        return BodyState{position, velocity, config.body_mass};
+    });
+}
+
+void generate_uniform_cloud(Bodies& bodies, const InitialConditionsConfig& config, ThreadPool& pool) {
+    auto first = bodies.get_count();
+    bodies.reserve(first + config.count);
+    bodies.append(config.count, pool, [&](size_t k) {
+        CounterRng rng(config.seed, first + k);
+        auto r = config.scale * std::cbrt(rng.uniform());
+        glm::vec4 position(rng.unit_vector() * r, 1.0f);
+        return BodyState{position, glm::vec4{0.0f}, config.body_mass};
+    });
+}
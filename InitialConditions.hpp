@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "Bodies.hpp"
+#include "ThreadPool.hpp"
+
+// Counter-based random numbers: the k-th draw of a stream is a hash of
+// (seed, stream, k), so every body can draw its own numbers on any thread
+// and the result does not depend on how the bodies are split between them.
+class CounterRng {
+    uint64_t key;
+    uint64_t counter{0};
+public:
+    CounterRng(uint64_t seed, uint64_t stream);
+
+    uint64_t next();
+    // [0, 1)
+    float uniform();
+    // (0, 1), safe to take the log of
+    float uniform_open();
+    // [-1, 1)
+    float uniform_signed();
+    glm::vec3 unit_vector();
+};
+
+struct InitialConditionsConfig {
+    size_t count = 1024;
+    uint64_t seed = 1;
+    float G = 0.000000001f;
+    // mass of every body of the equal-mass models
+    float body_mass = 0.12f;
+    // Plummer radius, disk scale length or cloud radius
+    float scale = 1.0f;
+};
+
+// The generators append config.count bodies in parallel, the bodies are the
+// same for a given seed whatever the size of the pool. Each body draws from
+// the stream of the slot it is appended to, so appending twice with the same
+// seed gives two different sets of bodies.
+
+// slowly rotating flat disk of radius scale with random masses, the
+// distribution the simulation always started from
+void generate_rotating_disk(Bodies& bodies, const InitialConditionsConfig& config, ThreadPool& pool);
+// Plummer sphere in virial equilibrium (Aarseth, Henon & Wielen 1974), cut
+// off at 10 Plummer radii
+void generate_plummer(Bodies& bodies, const InitialConditionsConfig& config, ThreadPool& pool);
+// exponential disk with a sech^2 vertical profile on circular orbits around
+// its own enclosed mass, cut off at 10 scale lengths
+void generate_exponential_disk(Bodies& bodies, const InitialConditionsConfig& config, ThreadPool& pool);
+// uniform sphere at rest, for cold collapse
+void generate_uniform_cloud(Bodies& bodies, const InitialConditionsConfig& config, ThreadPool& pool);
@@ -0,0 +1,290 @@
+#include "Integrator.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+void acceleration_jerk(const std::vector<glm::vec4>& positions,
+                       const std::vector<glm::vec4>& velocities,
+                       const std::vector<float>& masses,
+                       size_t bodies_count,
+                       float G,
+                       size_t i,
+                       glm::vec4& acceleration,
+                       glm::vec4& jerk) {
+    auto pos = glm::vec3(positions[i]);
+    auto vel = glm::vec3(velocities[i]);
+    glm::vec3 acc{0.0f}, jrk{0.0f};
+    for(size_t j = 0; j < bodies_count; ++j) {
+        auto r = glm::vec3(positions[j]) - pos;
+        auto v = glm::vec3(velocities[j]) - vel;
+        auto r2 = glm::dot(r, r);
+        if(r2 == 0.0f)
+            continue;
+        auto inv_r = 1.0f / std::sqrt(r2);
+        auto inv_r2 = inv_r * inv_r;
+        auto m_inv_r3 = masses[j] * inv_r * inv_r2;
+        acc += r * m_inv_r3;
+        jrk += (v - r * (3.0f * glm::dot(r, v) * inv_r2)) * m_inv_r3;
+    }
+    acceleration = glm::vec4(acc * G, 0.0f);
+    jerk = glm::vec4(jrk * G, 0.0f);
+}
+}
+
+void calc_accelerations_jerks(const std::vector<glm::vec4>& positions,
+                              const std::vector<glm::vec4>& velocities,
+                              const std::vector<float>& masses,
+                              size_t bodies_count,
+                              float G,
+                              std::vector<glm::vec4>& accelerations,
+                              std::vector<glm::vec4>& jerks,
+                              ThreadPool& pool) {
+    accelerations.resize(bodies_count);
+    jerks.resize(bodies_count);
+    pool.parallel_for(0, bodies_count, 16, [&](size_t begin, size_t end) {
+        for(auto i = begin; i < end; ++i)
+            acceleration_jerk(positions, velocities, masses, bodies_count, G, i, accelerations[i], jerks[i]);
+    });
+}
+
+void calc_accelerations_jerks(const std::vector<glm::vec4>& positions,
+                              const std::vector<glm::vec4>& velocities,
+                              const std::vector<float>& masses,
+                              size_t bodies_count,
+                              float G,
+                              std::span<const uint32_t> targets,
+                              std::vector<glm::vec4>& accelerations,
+                              std::vector<glm::vec4>& jerks,
+                              ThreadPool& pool) {
+    accelerations.resize(bodies_count);
+    jerks.resize(bodies_count);
+    pool.parallel_for(0, targets.size(), 16, [&](size_t begin, size_t end) {
+        for(auto k = begin; k < end; ++k) {
+            auto i = targets[k];
+            acceleration_jerk(positions, velocities, masses, bodies_count, G, i, accelerations[i], jerks[i]);
+        }
+    });
+}
+
+const char* integration_scheme_name(IntegrationScheme scheme) {
+    switch(scheme) {
+    case IntegrationScheme::Euler: return "euler";
+    case IntegrationScheme::Leapfrog: return "leapfrog";
+    case IntegrationScheme::Hermite: return "hermite";
+    }
+    return "unknown";
+}
+
+bool parse_integration_scheme(const std::string& name, IntegrationScheme& scheme) {
+    for(auto candidate : integration_schemes) {
+        if(name == integration_scheme_name(candidate)) {
+            scheme = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+Integrator::Integrator(IntegratorConfig config) {
+    set_config(config);
+}
+
+const IntegratorConfig& Integrator::get_config() const {
+    return config;
+}
+
+void Integrator::set_config(IntegratorConfig config) {
+    if(config.block_levels > max_block_levels)
+        throw std::runtime_error("at most " + std::to_string(max_block_levels) + " block levels");
+    if(config.scheme != this->config.scheme || config.block_levels != this->config.block_levels)
+        invalidate();
+    this->config = config;
+}
+
+void Integrator::invalidate() {
+    valid = false;
+}
+
+IntegratorState Integrator::get_state() const {
+    IntegratorState state{config, valid, {}, {}, {}};
+    if(!valid)
+        return state;
+    state.accelerations = accelerations;
+    if(config.scheme == IntegrationScheme::Hermite) {
+        state.jerks = jerks;
+        state.levels = levels;
+    }
+    return state;
+}
+
+void Integrator::set_state(IntegratorState state) {
+    set_config(state.config);
+    valid = state.valid;
+    accelerations = std::move(state.accelerations);
+    jerks = std::move(state.jerks);
+    levels = std::move(state.levels);
+}
+
+void Integrator::accelerations_from_forces(const Bodies& bodies,
+                                           const std::vector<glm::vec4>& forces,
+                                           ThreadPool& pool) {
+    auto& masses = bodies.get_masses();
+    accelerations.resize(bodies.get_count());
+    pool.parallel_for(0, bodies.get_count(), [&](size_t begin, size_t end) {
+        for(auto i = begin; i < end; ++i)
+            accelerations[i] = forces[i] / masses[i];
+    });
+}
+
+void Integrator::step_euler(Bodies& bodies, const std::vector<glm::vec4>& forces, ThreadPool& pool) {
+    auto& positions = bodies.get_positions();
+    auto& velocities = bodies.get_velocities();
+    auto& masses = bodies.get_masses();
+    auto dt = config.dt;
+    pool.parallel_for(0, bodies.get_count(), [&](size_t begin, size_t end) {
+        for(auto i = begin; i < end; ++i) {
+            velocities[i] += forces[i] / masses[i] * dt;
+            positions[i] += velocities[i] * dt;
+        }
+    });
+}
+
+void Integrator::step_leapfrog(Bodies& bodies,
+                               const std::function<std::vector<glm::vec4>(Bodies&)>& calc_forces,
+                               ThreadPool& pool) {
+    if(!valid)
+        accelerations_from_forces(bodies, calc_forces(bodies), pool);
+
+    auto& positions = bodies.get_positions();
+    auto& velocities = bodies.get_velocities();
+    auto half_dt = config.dt * 0.5f;
+    auto dt = config.dt;
+    pool.parallel_for(0, bodies.get_count(), [&](size_t begin, size_t end) {
+        for(auto i = begin; i < end; ++i) {
+            velocities[i] += accelerations[i] * half_dt;
+            positions[i] += velocities[i] * dt;
+        }
+    });
+
+    accelerations_from_forces(bodies, calc_forces(bodies), pool);
+    pool.parallel_for(0, bodies.get_count(), [&](size_t begin, size_t end) {
+        for(auto i = begin; i < end; ++i)
+            velocities[i] += accelerations[i] * half_dt;
+    });
+    valid = true;
+}
+
+uint32_t Integrator::block_level(glm::vec4 acceleration, glm::vec4 jerk) const {
+    auto jerk_length = glm::length(jerk);
+    if(jerk_length == 0.0f)
+        return 0;
+    auto dt = config.eta * glm::length(acceleration) / jerk_length;
+    auto max_level = std::min(config.block_levels, max_block_levels);
+    uint32_t level = 0;
+    while(level < max_level && config.dt / float(1u << level) > dt)
+        ++level;
+    return level;
+}
+
+// Hermite with block timesteps. Time inside a step is counted in ticks of
+// dt / 2^block_levels, a body on level l advances 2^(block_levels - l) ticks
+// at once. Every substep jumps to the earliest tick some body is due at,
+// predicts all bodies to it and evaluates and corrects only the due ones.
+// A body may refine its level at any time, but only coarsen by one level and
+// only on a tick aligned to the coarser step.
+void Integrator::step_hermite(Bodies& bodies, float G, ThreadPool& pool) {
+    auto& positions = bodies.get_positions();
+    auto& velocities = bodies.get_velocities();
+    auto& masses = bodies.get_masses();
+    auto count = bodies.get_count();
+    auto max_level = std::min(config.block_levels, max_block_levels);
+    uint32_t step_ticks = 1u << max_level;
+    auto tick_dt = config.dt / float(step_ticks);
+    if(!valid) {
+        calc_accelerations_jerks(positions, velocities, masses, count, G, accelerations, jerks, pool);
+        levels.resize(count);
+        pool.parallel_for(0, count, [&](size_t begin, size_t end) {
+            for(auto i = begin; i < end; ++i)
+                levels[i] = std::min(block_level(accelerations[i], jerks[i]), max_level);
+        });
+    }
+
+    ticks.assign(count, 0);
+    predicted_positions.resize(count);
+    predicted_velocities.resize(count);
+    old_accelerations.resize(count);
+    old_jerks.resize(count);
+    for(uint32_t now = 0; now < step_ticks;) {
+        auto next = step_ticks;
+        for(size_t i = 0; i < count; ++i)
+            next = std::min(next, ticks[i] + (step_ticks >> levels[i]));
+        active.clear();
+        for(size_t i = 0; i < count; ++i)
+            if(ticks[i] + (step_ticks >> levels[i]) == next)
+                active.push_back(i);
+
+        pool.parallel_for(0, count, [&](size_t begin, size_t end) {
+            for(auto i = begin; i < end; ++i) {
+                auto dt = float(next - ticks[i]) * tick_dt;
+                auto dt2 = dt * dt;
+                predicted_positions[i] = positions[i]
+                                       + velocities[i] * dt
+                                       + accelerations[i] * (dt2 / 2.0f)
+                                       + jerks[i] * (dt2 * dt / 6.0f);
+                predicted_velocities[i] = velocities[i]
+                                        + accelerations[i] * dt
+                                        + jerks[i] * (dt2 / 2.0f);
+            }
+        });
+        pool.parallel_for(0, active.size(), [&](size_t begin, size_t end) {
+            for(auto k = begin; k < end; ++k) {
+                old_accelerations[active[k]] = accelerations[active[k]];
+                old_jerks[active[k]] = jerks[active[k]];
+            }
+        });
+
+        calc_accelerations_jerks(predicted_positions, predicted_velocities, masses, count, G,
+                                 active, accelerations, jerks, pool);
+        pool.parallel_for(0, active.size(), [&](size_t begin, size_t end) {
+            for(auto k = begin; k < end; ++k) {
+                auto i = active[k];
+                auto dt = float(next - ticks[i]) * tick_dt;
+                auto dt2 = dt * dt;
+                auto velocity = velocities[i]
+                              + (old_accelerations[i] + accelerations[i]) * (dt / 2.0f)
+                              + (old_jerks[i] - jerks[i]) * (dt2 / 12.0f);
+                positions[i] += (velocities[i] + velocity) * (dt / 2.0f)
+                              + (old_accelerations[i] - accelerations[i]) * (dt2 / 12.0f);
+                velocities[i] = velocity;
+                ticks[i] = next;
+
+                auto level = std::min(block_level(accelerations[i], jerks[i]), max_level);
+                if(level > levels[i])
+                    levels[i] = level;
+                else if(level < levels[i] && next % (step_ticks >> (levels[i] - 1)) == 0)
+                    levels[i] -= 1;
+            }
+        });
+        now = next;
+    }
+    valid = true;
+}
+
+void Integrator::step(Bodies& bodies,
+                      float G,
+                      const std::function<std::vector<glm::vec4>(Bodies&)>& calc_forces,
+                      ThreadPool& pool) {
+    switch(config.scheme) {
+    case IntegrationScheme::Euler:
+        step_euler(bodies, calc_forces(bodies), pool);
+        break;
+    case IntegrationScheme::Leapfrog:
+        step_leapfrog(bodies, calc_forces, pool);
+        break;
+    case IntegrationScheme::Hermite:
+        step_hermite(bodies, G, pool);
+        break;
+    }
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <functional>
+#include <string>
+#include <glm/glm.hpp>
+
+#include "Bodies.hpp"
+#include "ThreadPool.hpp"
+
+enum class IntegrationScheme {
+    // v += a dt, x += v dt
+    Euler,
+    // kick-drift-kick leapfrog, symplectic, one force evaluation per step
+    Leapfrog,
+    // 4th order predictor-corrector with jerks, always uses the direct sum,
+    // optionally with individual block timesteps
+    Hermite
+};
+
+inline constexpr IntegrationScheme integration_schemes[] = {
+    IntegrationScheme::Euler,
+    IntegrationScheme::Leapfrog,
+    IntegrationScheme::Hermite
+};
+
+// euler | leapfrog | hermite
+const char* integration_scheme_name(IntegrationScheme scheme);
+bool parse_integration_scheme(const std::string& name, IntegrationScheme& scheme);
+
+struct IntegratorConfig {
+    // Euler keeps the trajectories of runs from before the integrators
+    IntegrationScheme scheme = IntegrationScheme::Euler;
+    float dt = 1.0f;
+    // Hermite only: bodies step with dt / 2^level, level in [0, block_levels]
+    // picked from dt_i = eta |a| / |j|. Every body is synchronised again at
+    // the end of a step.
+    uint32_t block_levels = 0;
+    float eta = 0.02f;
+};
+
+// most block levels, a step is 2^block_levels ticks in a uint32_t
+constexpr uint32_t max_block_levels = 30;
+
+// What an Integrator carries from one step to the next, by body slot. A
+// checkpoint needs it to continue bitwise: Hermite keeps accelerations from
+// predicted positions and block levels that only coarsen slowly, neither
+// can be recomputed from the bodies alone.
+struct IntegratorState {
+    IntegratorConfig config;
+    bool valid = false;
+    std::vector<glm::vec4> accelerations;
+    std::vector<glm::vec4> jerks;
+    std::vector<uint32_t> levels;
+};
+
+// acc[i] and jerk[i] of body i from all others:
+// a = G m_j r / |r|^3, j = G m_j (v / |r|^3 - 3 (r.v) r / |r|^5)
+void calc_accelerations_jerks(const std::vector<glm::vec4>& positions,
+                              const std::vector<glm::vec4>& velocities,
+                              const std::vector<float>& masses,
+                              size_t bodies_count,
+                              float G,
+                              std::vector<glm::vec4>& accelerations,
+                              std::vector<glm::vec4>& jerks,
+                              ThreadPool& pool);
+
+// the same for the target bodies only, sources are still all bodies
+void calc_accelerations_jerks(const std::vector<glm::vec4>& positions,
+                              const std::vector<glm::vec4>& velocities,
+                              const std::vector<float>& masses,
+                              size_t bodies_count,
+                              float G,
+                              std::span<const uint32_t> targets,
+                              std::vector<glm::vec4>& accelerations,
+                              std::vector<glm::vec4>& jerks,
+                              ThreadPool& pool);
+
+// Keeps the accelerations (and jerks) of the last evaluation, so a step
+// starts from them instead of evaluating twice. They belong to body slots:
+// call invalidate() whenever bodies were changed outside the integrator,
+// e.g. after collisions merged some.
+class Integrator {
+    IntegratorConfig config;
+    std::vector<glm::vec4> accelerations;
+    std::vector<glm::vec4> jerks;
+    std::vector<glm::vec4> old_accelerations;
+    std::vector<glm::vec4> old_jerks;
+    std::vector<glm::vec4> predicted_positions;
+    std::vector<glm::vec4> predicted_velocities;
+    std::vector<uint32_t> levels;
+    std::vector<uint32_t> ticks;
+    std::vector<uint32_t> active;
+    bool valid = false;
+
+    uint32_t block_level(glm::vec4 acceleration, glm::vec4 jerk) const;
+
+    void accelerations_from_forces(const Bodies& bodies, const std::vector<glm::vec4>& forces, ThreadPool& pool);
+    void step_euler(Bodies& bodies, const std::vector<glm::vec4>& forces, ThreadPool& pool);
+    void step_leapfrog(Bodies& bodies, const std::function<std::vector<glm::vec4>(Bodies&)>& calc_forces, ThreadPool& pool);
+    void step_hermite(Bodies& bodies, float G, ThreadPool& pool);
+public:
+    Integrator(IntegratorConfig config = {});
+
+    const IntegratorConfig& get_config() const;
+    // throws for more than max_block_levels
+    void set_config(IntegratorConfig config);
+    void invalidate();
+    IntegratorState get_state() const;
+    // the arrays must match the bodies the next step() gets
+    void set_state(IntegratorState state);
+
+    // calc_forces(bodies) returns the gravity forces at the current positions
+    void step(Bodies& bodies,
+              float G,
+              const std::function<std::vector<glm::vec4>(Bodies&)>& calc_forces,
+              ThreadPool& pool);
+};
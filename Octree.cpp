@@ -0,0 +1,119 @@
+#include "Octree.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <array>
+
+Octree::Octree(size_t leaf_capacity, size_t max_depth)
+    : leaf_capacity(std::max<size_t>(1, leaf_capacity))
+    , max_depth(max_depth) {}
+
+void Octree::build(const std::vector<glm::vec4>& positions,
+                   const std::vector<float>& masses,
+                   size_t count) {
+    nodes.clear();
+    order.resize(count);
+    std::iota(order.begin(), order.end(), 0u);
+
+    glm::vec3 min_pos{0.0f}, max_pos{0.0f};
+    if(count > 0) {
+        min_pos = max_pos = glm::vec3(positions[0]);
+    }
+    for(size_t i = 1; i < count; ++i) {
+        min_pos = glm::min(min_pos, glm::vec3(positions[i]));
+        max_pos = glm::max(max_pos, glm::vec3(positions[i]));
+    }
+    auto extent = max_pos - min_pos;
+    auto half_size = std::max({extent.x, extent.y, extent.z, 1e-6f}) * 0.5f * 1.0001f;
+
+    OctreeNode root{};
+    root.center = (min_pos + max_pos) * 0.5f;
+    root.half_size = half_size;
+    root.body_begin = 0;
+    root.body_end = count;
+    nodes.push_back(root);
+
+    build_node(0, positions.data(), masses.data(), 0);
+}
+
+void Octree::build_node(uint32_t node_id,
+                        const glm::vec4* positions,
+                        const float* masses,
+                        size_t depth) {
+    auto begin = nodes[node_id].body_begin;
+    auto end = nodes[node_id].body_end;
+    auto center = nodes[node_id].center;
+    auto half_size = nodes[node_id].half_size;
+
+    glm::vec3 weighted_pos{0.0f};
+    float mass = 0.0f;
+
+    if(end - begin <= leaf_capacity || depth >= max_depth) {
+        for(auto i = begin; i < end; ++i) {
+            auto id = order[i];
+            weighted_pos += glm::vec3(positions[id]) * masses[id];
+            mass += masses[id];
+        }
+    } else {
+        auto first = order.begin() + begin;
+        auto last = order.begin() + end;
+        auto split = [&](auto from, auto to, int axis) {
+            return std::partition(from, to, [&](uint32_t id) {
+                return positions[id][axis] < center[axis];
+            });
+        };
+
+        // octant index bits: x - 4, y - 2, z - 1
+        std::array<decltype(first), 9> bounds;
+        bounds[0] = first;
+        bounds[8] = last;
+        bounds[4] = split(bounds[0], bounds[8], 0);
+        bounds[2] = split(bounds[0], bounds[4], 1);
+        bounds[6] = split(bounds[4], bounds[8], 1);
+        for(auto i : {1, 3, 5, 7})
+            bounds[i] = split(bounds[i - 1], bounds[i + 1], 2);
+
+        uint32_t first_child = nodes.size();
+        uint32_t child_count = 0;
+        auto child_half = half_size * 0.5f;
+        for(int octant = 0; octant < 8; ++octant) {
+            if(bounds[octant] == bounds[octant + 1])
+                continue;
+            glm::vec3 offset{(octant & 4) ? child_half : -child_half,
+                             (octant & 2) ? child_half : -child_half,
+                             (octant & 1) ? child_half : -child_half};
+            OctreeNode child{};
+            child.center = center + offset;
+            child.half_size = child_half;
+            child.body_begin = bounds[octant] - order.begin();
+            child.body_end = bounds[octant + 1] - order.begin();
+            nodes.push_back(child);
+            ++child_count;
+        }
+        nodes[node_id].first_child = first_child;
+        nodes[node_id].child_count = child_count;
+
+        for(auto child_id = first_child; child_id < first_child + child_count; ++child_id) {
+            build_node(child_id, positions, masses, depth + 1);
+            weighted_pos += nodes[child_id].mass_center * nodes[child_id].mass;
+            mass += nodes[child_id].mass;
+        }
+    }
+
+    auto& node = nodes[node_id];
+    node.mass = mass;
+    node.mass_center = mass > 0.0f ? weighted_pos / mass : center;
+    node.mass_center_offset = glm::distance(node.mass_center, center);
+}
+
+const std::vector<OctreeNode>& Octree::get_nodes() const {
+    return nodes;
+}
+
+const std::vector<uint32_t>& Octree::get_order() const {
+    return order;
+}
+
+const OctreeNode& Octree::root() const {
+    return nodes.front();
+}
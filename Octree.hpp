@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+struct OctreeNode {
+    glm::vec3 center;
+    float half_size;
+    glm::vec3 mass_center;
+    float mass;
+    // distance between geometric center and center of mass, widens the opening radius
+    float mass_center_offset;
+    uint32_t first_child;
+    uint32_t child_count;
+    uint32_t body_begin;
+    uint32_t body_end;
+
+    bool is_leaf() const { return child_count == 0; }
+};
+
+class Octree {
+    std::vector<OctreeNode> nodes;
+    std::vector<uint32_t> order;
+    size_t leaf_capacity;
+    size_t max_depth;
+
+    void build_node(uint32_t node_id,
+                    const glm::vec4* positions,
+                    const float* masses,
+                    size_t depth);
+public:
+    Octree(size_t leaf_capacity = 16, size_t max_depth = 32);
+
+    void build(const std::vector<glm::vec4>& positions,
+               const std::vector<float>& masses,
+               size_t count);
+
+    const std::vector<OctreeNode>& get_nodes() const;
+    const std::vector<uint32_t>& get_order() const;
+    const OctreeNode& root() const;
+};
@@ -0,0 +1,129 @@
+#include "PairTiling.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+namespace {
+struct Block {
+    size_t begin;
+    size_t end;
+};
+
+// block positions and masses as separate float streams plus force accumulators
+struct Tile {
+    std::vector<float> x, y, z, m;
+    std::vector<float> fx, fy, fz;
+
+    void load(const glm::vec4* positions, const float* masses, Block block) {
+        auto n = block.end - block.begin;
+        for(auto stream : {&x, &y, &z, &m})
+            stream->resize(n);
+        for(auto stream : {&fx, &fy, &fz})
+            stream->assign(n, 0.0f);
+        for(size_t i = 0; i < n; ++i) {
+            x[i] = positions[block.begin + i].x;
+            y[i] = positions[block.begin + i].y;
+            z[i] = positions[block.begin + i].z;
+            m[i] = masses[block.begin + i];
+        }
+    }
+
+    void store(std::vector<glm::vec4>& forces, Block block, float G) const {
+        for(auto i = block.begin; i < block.end; ++i) {
+            auto k = i - block.begin;
+            forces[i] += glm::vec4(fx[k], fy[k], fz[k], 0.0f) * G;
+        }
+    }
+};
+
+void tile_forces(Tile& a, Tile& b, bool diagonal) {
+    auto n = b.x.size();
+    for(size_t i = 0; i < a.x.size(); ++i) {
+        auto xi = a.x[i], yi = a.y[i], zi = a.z[i], mi = a.m[i];
+        float ax = 0.0f, ay = 0.0f, az = 0.0f;
+        for(auto j = diagonal ? i + 1 : 0; j < n; ++j) {
+            auto dx = b.x[j] - xi, dy = b.y[j] - yi, dz = b.z[j] - zi;
+            auto dist2 = dx * dx + dy * dy + dz * dz;
+            auto s = dist2 > 0.0f ? mi * b.m[j] / (dist2 * std::sqrt(dist2)) : 0.0f;
+            ax += dx * s;
+            ay += dy * s;
+            az += dz * s;
+            b.fx[j] -= dx * s;
+            b.fy[j] -= dy * s;
+            b.fz[j] -= dz * s;
+        }
+        a.fx[i] += ax;
+        a.fy[i] += ay;
+        a.fz[i] += az;
+    }
+}
+}
+
+size_t pair_tile_block_size(size_t bodies_count) {
+    // 64 blocks give rounds of 32 tiles, two per thread up to 16 threads,
+    // and stay small enough for L1/L2
+    auto per_block = bodies_count / 64;
+    return std::clamp<size_t>(std::bit_floor(std::max<size_t>(1, per_block)), 32, 512);
+}
+
+std::vector<glm::vec4> calc_forces_tiled(const std::vector<glm::vec4>& positions,
+                                         const std::vector<float>& masses,
+                                         size_t bodies_count,
+                                         ThreadPool& pool,
+                                         float G,
+                                         size_t block_size) {
+    std::vector<glm::vec4> forces(bodies_count);
+    if(bodies_count == 0)
+        return forces;
+    if(block_size == 0)
+        block_size = pair_tile_block_size(bodies_count);
+
+    auto blocks_count = (bodies_count + block_size - 1) / block_size;
+    auto block = [&](size_t id) {
+        return Block{id * block_size, std::min(bodies_count, (id + 1) * block_size)};
+    };
+
+    auto run_tile = [&](Block a, Block b) {
+        thread_local Tile tile_a, tile_b;
+        auto diagonal = a.begin == b.begin;
+        tile_a.load(positions.data(), masses.data(), a);
+        if(diagonal) {
+            tile_forces(tile_a, tile_a, true);
+            tile_a.store(forces, a, G);
+            return;
+        }
+        tile_b.load(positions.data(), masses.data(), b);
+        tile_forces(tile_a, tile_b, false);
+        tile_a.store(forces, a, G);
+        tile_b.store(forces, b, G);
+    };
+
+    pool.parallel_for(0, blocks_count, 1, [&](size_t begin, size_t end) {
+        for(auto id = begin; id < end; ++id)
+            run_tile(block(id), block(id));
+    });
+
+    // circle method: with an even number of slots every round pairs each
+    // slot exactly once, slot `blocks_count` of an odd count is a bye
+    auto slots = blocks_count + blocks_count % 2;
+    for(size_t round = 0; round + 1 < slots; ++round) {
+        pool.parallel_for(0, slots / 2, 1, [&](size_t begin, size_t end) {
+            for(auto k = begin; k < end; ++k) {
+                size_t a, b;
+                if(k == 0) {
+                    a = round;
+                    b = slots - 1;
+                } else {
+                    a = (round + k) % (slots - 1);
+                    b = (round + slots - 1 - k) % (slots - 1);
+                }
+                if(a >= blocks_count || b >= blocks_count)
+                    continue;
+                run_tile(block(std::min(a, b)), block(std::max(a, b)));
+            }
+        });
+    }
+
+    return forces;
+}
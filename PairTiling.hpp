@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+
+// Splits the triangular pair space into block_size x block_size tiles. Tiles
+// are scheduled in round-robin rounds where no two tiles share a block, so
+// every task owns both of its force blocks for the round and adds its tile
+// buffers straight into them: no per-thread force arrays and no reduction.
+// Each body then sums its tiles in round order, so for a given block size
+// the forces are the same bits for any thread count.
+//
+// The default block size depends on the body count only, to keep that.
+size_t pair_tile_block_size(size_t bodies_count);
+
+std::vector<glm::vec4> calc_forces_tiled(const std::vector<glm::vec4>& positions,
+                                         const std::vector<float>& masses,
+                                         size_t bodies_count,
+                                         ThreadPool& pool,
+                                         float G,
+                                         size_t block_size = 0);
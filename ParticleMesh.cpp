@@ -0,0 +1,218 @@
+#include "ParticleMesh.hpp"
+
+#include <array>
+#include <bit>
+#include <numbers>
+#include <map>
+#include <mutex>
+
+namespace {
+struct AxisWeights {
+    int first;
+    int count;
+    std::array<float, 3> w;
+};
+
+AxisWeights axis_weights(float u, MassAssignment assignment) {
+    if(assignment == MassAssignment::CIC) {
+        auto i = std::floor(u);
+        auto f = u - i;
+        return {int(i), 2, {1.0f - f, f, 0.0f}};
+    }
+    auto i = std::floor(u + 0.5f);
+    auto d = u - i;
+    return {int(i) - 1, 3, {0.5f * (0.5f - d) * (0.5f - d),
+                            0.75f - d * d,
+                            0.5f * (0.5f + d) * (0.5f + d)}};
+}
+}
+
+ParticleMesh::ParticleMesh(size_t grid_size, MassAssignment assignment)
+    : grid_size(std::bit_ceil(std::max<size_t>(8, grid_size)))
+    , padded_size(this->grid_size * 2)
+    , assignment(assignment) {
+    twiddles.resize(padded_size / 2);
+    for(size_t i = 0; i < twiddles.size(); ++i)
+        twiddles[i] = std::polar(1.0f, -2.0f * std::numbers::pi_v<float> * i / padded_size);
+}
+
+size_t ParticleMesh::padded_index(size_t x, size_t y, size_t z) const {
+    return (x * padded_size + y) * padded_size + z;
+}
+
+void ParticleMesh::fft_line(std::complex<float>* data, bool inverse) const {
+    auto n = padded_size;
+    for(size_t i = 1, j = 0; i < n; ++i) {
+        auto bit = n >> 1;
+        for(; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if(i < j)
+            std::swap(data[i], data[j]);
+    }
+    for(size_t len = 2; len <= n; len <<= 1) {
+        auto step = n / len;
+        for(size_t i = 0; i < n; i += len)
+            for(size_t k = 0; k < len / 2; ++k) {
+                auto w = twiddles[k * step];
+                if(inverse)
+                    w = std::conj(w);
+                auto a = data[i + k];
+                auto b = data[i + k + len / 2] * w;
+                data[i + k] = a + b;
+                data[i + k + len / 2] = a - b;
+            }
+    }
+}
+
+// Lines outside the nonzero corner of the padded mesh are all zeros and are
+// skipped by the first two passes.
+void ParticleMesh::fft_3d(std::vector<std::complex<float>>& grid,
+                          bool inverse,
+                          size_t nonzero,
+                          ThreadPool& pool) const {
+    auto n = padded_size;
+
+    pool.parallel_for(0, nonzero * nonzero, [&](size_t begin, size_t end) {
+        for(auto line = begin; line < end; ++line)
+            fft_line(&grid[padded_index(line / nonzero, line % nonzero, 0)], inverse);
+    });
+
+    auto strided = [&](size_t lines, size_t stride, auto line_start) {
+        pool.parallel_for(0, lines, [&](size_t begin, size_t end) {
+            std::vector<std::complex<float>> buffer(n);
+            for(auto line = begin; line < end; ++line) {
+                auto start = line_start(line);
+                for(size_t i = 0; i < n; ++i)
+                    buffer[i] = grid[start + i * stride];
+                fft_line(buffer.data(), inverse);
+                for(size_t i = 0; i < n; ++i)
+                    grid[start + i * stride] = buffer[i];
+            }
+        });
+    };
+    strided(nonzero * n, n, [&](size_t line) {
+        return padded_index(line / n, 0, line % n);
+    });
+    strided(n * n, n * n, [&](size_t line) {
+        return padded_index(0, line / n, line % n);
+    });
+}
+
+// Green's function of the isolated problem in cell units, the self term is
+// softened to the neighbour distance. It depends only on the mesh size, so the
+// transformed kernel is shared between solvers.
+std::shared_ptr<const std::vector<std::complex<float>>> ParticleMesh::make_kernel(ThreadPool& pool) const {
+    static std::mutex cache_mutex;
+    static std::map<size_t, std::shared_ptr<const std::vector<std::complex<float>>>> cache;
+    std::lock_guard lock(cache_mutex);
+    if(auto it = cache.find(padded_size); it != cache.end())
+        return it->second;
+
+    auto n = padded_size;
+    std::vector<std::complex<float>> kernel(n * n * n);
+    auto wrap = [n](size_t i) {
+        return float(i < n / 2 ? i : n - i);
+    };
+    pool.parallel_for(0, n, [&](size_t begin, size_t end) {
+        for(auto x = begin; x < end; ++x)
+            for(size_t y = 0; y < n; ++y)
+                for(size_t z = 0; z < n; ++z) {
+                    glm::vec3 d{wrap(x), wrap(y), wrap(z)};
+                    kernel[padded_index(x, y, z)] = 1.0f / std::max(1.0f, glm::length(d));
+                }
+    });
+    fft_3d(kernel, false, n, pool);
+    auto shared = std::make_shared<const std::vector<std::complex<float>>>(std::move(kernel));
+    cache[padded_size] = shared;
+    return shared;
+}
+
+std::vector<glm::vec4> ParticleMesh::calc_forces(const std::vector<glm::vec4>& positions,
+                                                 const std::vector<float>& masses,
+                                                 size_t bodies_count,
+                                                 float G,
+                                                 ThreadPool& pool) {
+    std::vector<glm::vec4> forces(bodies_count);
+    if(bodies_count == 0)
+        return forces;
+    if(!kernel)
+        kernel = make_kernel(pool);
+
+    glm::vec3 min_pos{positions[0]}, max_pos{positions[0]};
+    for(size_t i = 1; i < bodies_count; ++i) {
+        min_pos = glm::min(min_pos, glm::vec3(positions[i]));
+        max_pos = glm::max(max_pos, glm::vec3(positions[i]));
+    }
+    auto extent = max_pos - min_pos;
+    // two spare cells on each side keep the TSC stencil and the gradient inside the mesh
+    auto h = std::max({extent.x, extent.y, extent.z, 1e-6f}) / (grid_size - 4) * 1.0001f;
+    auto origin = min_pos - glm::vec3(2.0f * h);
+    auto g = grid_size;
+
+    density.resize(pool.size());
+    pool.parallel_for(0, density.size(), 1, [&](size_t begin, size_t end) {
+        for(auto t = begin; t < end; ++t)
+            density[t].assign(g * g * g, 0.0f);
+    });
+    pool.parallel_for(0, bodies_count, [&](size_t begin, size_t end, size_t worker) {
+        auto& rho = density[worker];
+        for(auto id = begin; id < end; ++id) {
+            auto u = (glm::vec3(positions[id]) - origin) / h;
+            auto wx = axis_weights(u.x, assignment);
+            auto wy = axis_weights(u.y, assignment);
+            auto wz = axis_weights(u.z, assignment);
+            for(int i = 0; i < wx.count; ++i)
+                for(int j = 0; j < wy.count; ++j)
+                    for(int k = 0; k < wz.count; ++k)
+                        rho[((wx.first + i) * g + wy.first + j) * g + wz.first + k]
+                            += masses[id] * wx.w[i] * wy.w[j] * wz.w[k];
+        }
+    });
+
+    mesh.assign(padded_size * padded_size * padded_size, {});
+    pool.parallel_for(0, g, [&](size_t begin, size_t end) {
+        for(auto x = begin; x < end; ++x)
+            for(size_t y = 0; y < g; ++y)
+                for(size_t z = 0; z < g; ++z) {
+                    float sum = 0.0f;
+                    for(auto& rho : density)
+                        sum += rho[(x * g + y) * g + z];
+                    mesh[padded_index(x, y, z)] = sum;
+                }
+    });
+
+    fft_3d(mesh, false, g, pool);
+    pool.parallel_for(0, mesh.size(), [&](size_t begin, size_t end) {
+        for(auto i = begin; i < end; ++i)
+            mesh[i] *= (*kernel)[i];
+    });
+    fft_3d(mesh, true, padded_size, pool);
+
+    float cells = padded_size * padded_size * padded_size;
+    auto potential = [&](int x, int y, int z) {
+        return mesh[padded_index(x, y, z)].real() / (cells * h);
+    };
+
+    pool.parallel_for(0, bodies_count, [&](size_t begin, size_t end) {
+        for(auto id = begin; id < end; ++id) {
+            auto u = (glm::vec3(positions[id]) - origin) / h;
+            auto wx = axis_weights(u.x, assignment);
+            auto wy = axis_weights(u.y, assignment);
+            auto wz = axis_weights(u.z, assignment);
+            glm::vec3 grad{0.0f};
+            for(int i = 0; i < wx.count; ++i)
+                for(int j = 0; j < wy.count; ++j)
+                    for(int k = 0; k < wz.count; ++k) {
+                        int x = wx.first + i, y = wy.first + j, z = wz.first + k;
+                        glm::vec3 node_grad{potential(x + 1, y, z) - potential(x - 1, y, z),
+                                            potential(x, y + 1, z) - potential(x, y - 1, z),
+                                            potential(x, y, z + 1) - potential(x, y, z - 1)};
+                        grad += node_grad * (wx.w[i] * wy.w[j] * wz.w[k] / (2.0f * h));
+                    }
+            forces[id] = glm::vec4(grad * (G * masses[id]), 0.0f);
+        }
+    });
+
+    return forces;
+}
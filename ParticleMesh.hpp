@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include <complex>
+#include <memory>
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+
+enum class MassAssignment {
+    CIC,
+    TSC
+};
+
+// Isolated-boundary particle-mesh solver: masses are deposited on a
+// grid_size^3 mesh spanning the bodies, convolved with 1/r on a zero-padded
+// (2 * grid_size)^3 mesh via FFT and the potential gradient is interpolated
+// back with the same assignment scheme.
+class ParticleMesh {
+    size_t grid_size;
+    size_t padded_size;
+    MassAssignment assignment;
+
+    std::vector<std::complex<float>> twiddles;
+    std::shared_ptr<const std::vector<std::complex<float>>> kernel;
+    std::vector<std::complex<float>> mesh;
+    std::vector<std::vector<float>> density;
+
+    size_t padded_index(size_t x, size_t y, size_t z) const;
+    void fft_line(std::complex<float>* data, bool inverse) const;
+    void fft_3d(std::vector<std::complex<float>>& grid,
+                bool inverse,
+                size_t nonzero,
+                ThreadPool& pool) const;
+    std::shared_ptr<const std::vector<std::complex<float>>> make_kernel(ThreadPool& pool) const;
+public:
+    ParticleMesh(size_t grid_size = 64, MassAssignment assignment = MassAssignment::CIC);
+
+    std::vector<glm::vec4> calc_forces(const std::vector<glm::vec4>& positions,
+                                       const std::vector<float>& masses,
+                                       size_t bodies_count,
+                                       float G,
+                                       ThreadPool& pool);
+};
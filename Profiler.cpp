@@ -0,0 +1,124 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+struct PhaseRing {
+    static constexpr size_t capacity = 1 << 14;
+
+    std::unique_ptr<PhaseEvent[]> events = std::make_unique<PhaseEvent[]>(capacity);
+    std::atomic<uint64_t> written{0};
+    size_t thread_index{0};
+};
+
+const auto epoch = std::chrono::steady_clock::now();
+std::mutex rings_mutex;
+// rings outlive their threads, a pool shut down early still shows up
+std::vector<std::shared_ptr<PhaseRing>> rings;
+
+PhaseRing& thread_ring() {
+    thread_local std::shared_ptr<PhaseRing> ring = [] {
+        auto ring = std::make_shared<PhaseRing>();
+        std::lock_guard lock(rings_mutex);
+        ring->thread_index = rings.size();
+        rings.push_back(ring);
+        return ring;
+    }();
+    return *ring;
+}
+
+template<typename F>
+void for_each_event(F&& fn) {
+    std::lock_guard lock(rings_mutex);
+    for(auto& ring : rings) {
+        auto written = ring->written.load(std::memory_order_acquire);
+        auto first = written > PhaseRing::capacity ? written - PhaseRing::capacity : 0;
+        for(auto i = first; i < written; ++i)
+            fn(*ring, ring->events[i % PhaseRing::capacity]);
+    }
+}
+
+void write_escaped(std::ostream& out, const char* str) {
+    for(; *str; ++str) {
+        if(*str == '"' || *str == '\\')
+            out << '\\';
+        out << *str;
+    }
+}
+}
+
+void profiler_record(const char* name,
+                     std::chrono::steady_clock::time_point start,
+                     std::chrono::nanoseconds duration) {
+    auto& ring = thread_ring();
+    auto written = ring.written.load(std::memory_order_relaxed);
+    ring.events[written % PhaseRing::capacity] = {
+        name,
+        uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch).count()),
+        uint64_t(duration.count())
+    };
+    ring.written.store(written + 1, std::memory_order_release);
+}
+
+void write_chrome_trace(std::ostream& out) {
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    for_each_event([&](const PhaseRing& ring, const PhaseEvent& event) {
+        out << (first ? "\n" : ",\n") << "{\"name\":\"";
+        write_escaped(out, event.name);
+        out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring.thread_index
+            << ",\"ts\":" << event.start_ns / 1000.0
+            << ",\"dur\":" << event.duration_ns / 1000.0 << "}";
+        first = false;
+    });
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+void write_profile_summary(std::ostream& out) {
+    std::map<std::string, std::vector<uint64_t>> phases;
+    for_each_event([&](const PhaseRing&, const PhaseEvent& event) {
+        phases[event.name].push_back(event.duration_ns);
+    });
+
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-24s %8s %12s %12s %12s\n", "phase", "count", "p50 us", "p99 us", "max us");
+    out << line;
+    for(auto& [name, durations] : phases) {
+        std::sort(durations.begin(), durations.end());
+        auto percentile = [&](double p) {
+            return durations[size_t(p * (durations.size() - 1) + 0.5)] / 1000.0;
+        };
+        std::snprintf(line, sizeof(line), "%-24s %8zu %12.1f %12.1f %12.1f\n",
+                      name.c_str(), durations.size(), percentile(0.5), percentile(0.99), durations.back() / 1000.0);
+        out << line;
+
+        // bucket k holds durations in [2^(k-1), 2^k) us, bucket 0 is < 1 us
+        std::vector<size_t> histogram;
+        for(auto ns : durations) {
+            size_t bucket = 0;
+            for(auto us = ns / 1000; us; us >>= 1)
+                ++bucket;
+            if(histogram.size() <= bucket)
+                histogram.resize(bucket + 1, 0);
+            ++histogram[bucket];
+        }
+        out << "    histogram:";
+        for(size_t bucket = 0; bucket < histogram.size(); ++bucket)
+            if(histogram[bucket])
+                out << " <" << (size_t(1) << bucket) << "us:" << histogram[bucket];
+        out << "\n";
+    }
+}
+
+void clear_profile() {
+    std::lock_guard lock(rings_mutex);
+    for(auto& ring : rings)
+        ring->written.store(0, std::memory_order_release);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#include "Utils.hpp"
+
+// Scoped phase timings. Every thread records into its own fixed-size ring,
+// so recording takes no lock and the oldest events are overwritten once the
+// ring is full. Only the first event of a thread registers its ring under a
+// mutex. The exports read all rings and must not overlap running phases.
+// Without GRAVITY_PROFILING (anything but Debug/RelWithDebInfo) PROFILE_SCOPE
+// expands to nothing.
+
+struct PhaseEvent {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+};
+
+void profiler_record(const char* name,
+                     std::chrono::steady_clock::time_point start,
+                     std::chrono::nanoseconds duration);
+
+// complete ("X") events, timestamps in microseconds since program start
+void write_chrome_trace(std::ostream& out);
+// count, p50, p99 and max per phase, plus a power-of-two histogram in us
+void write_profile_summary(std::ostream& out);
+void clear_profile();
+
+class ScopedPhase {
+    const char* name;
+    Timer<std::chrono::nanoseconds> timer;
+public:
+    explicit ScopedPhase(const char* name) : name(name) {}
+    ~ScopedPhase() { profiler_record(name, timer.start_time, timer.elapsed()); }
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef GRAVITY_PROFILING
+#define PROFILE_SCOPE(name) ScopedPhase PROFILE_CONCAT(profile_scope_, __LINE__){name}
+#else
+#define PROFILE_SCOPE(name) do {} while(0)
+#endif
@@ -0,0 +1,51 @@
+#include "SimulationClock.hpp"
+
+#include <algorithm>
+#include <thread>
+
+SimulationClock::SimulationClock(SimulationClockConfig config)
+    : config(config)
+    , start(clock::now()) {
+    this->config.max_steps_per_batch = std::max<size_t>(1, config.max_steps_per_batch);
+}
+
+SimulationClock::clock::time_point SimulationClock::tick_time(uint64_t tick) const {
+    return start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(double(tick) * tick_seconds()));
+}
+
+bool SimulationClock::is_fixed_rate() const {
+    return config.tick_rate > 0.0;
+}
+
+double SimulationClock::tick_seconds() const {
+    return is_fixed_rate() ? 1.0 / config.tick_rate : 0.0;
+}
+
+size_t SimulationClock::due() {
+    if(!is_fixed_rate()) {
+        ticks += config.max_steps_per_batch;
+        return config.max_steps_per_batch;
+    }
+    auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+    auto target = uint64_t(elapsed * config.tick_rate);
+    if(target <= ticks)
+        return 0;
+    if(target - ticks > config.max_steps_per_batch) {
+        // drop the backlog by moving the start forward
+        auto dropped = target - ticks - config.max_steps_per_batch;
+        start += std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(double(dropped) * tick_seconds()));
+        target = ticks + config.max_steps_per_batch;
+    }
+    auto steps = size_t(target - ticks);
+    ticks = target;
+    return steps;
+}
+
+void SimulationClock::wait_for_next_tick() const {
+    if(is_fixed_rate())
+        std::this_thread::sleep_until(tick_time(ticks + 1));
+}
+
+uint64_t SimulationClock::get_ticks() const {
+    return ticks;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+struct SimulationClockConfig {
+    // simulation steps per second of wall time, 0 runs as fast as possible.
+    // The GUI used to step once per rendered frame, it now defaults to 60.
+    double tick_rate = 60.0;
+    // most steps run back to back before the state is handed on
+    size_t max_steps_per_batch = 8;
+};
+
+// Fixed-rate simulation time. due() says how many steps to run now to keep
+// up with wall time; a backlog of more than one batch is dropped, so a
+// simulation that cannot keep up runs slower instead of falling further
+// behind with ever larger batches.
+class SimulationClock {
+public:
+    using clock = std::chrono::steady_clock;
+private:
+    SimulationClockConfig config;
+    clock::time_point start;
+    uint64_t ticks = 0;
+public:
+    explicit SimulationClock(SimulationClockConfig config = {});
+
+    bool is_fixed_rate() const;
+    double tick_seconds() const;
+    // counts the returned steps as done
+    size_t due();
+    void wait_for_next_tick() const;
+    uint64_t get_ticks() const;
+    // wall time the tick is due at, moves when a backlog is dropped
+    clock::time_point tick_time(uint64_t tick) const;
+};
@@ -0,0 +1,84 @@
+#include "SimulationThread.hpp"
+
+#include <algorithm>
+
+#include "Profiler.hpp"
+
+SimulationThread::SimulationThread(Bodies& bodies, ComputeRoutine& routine, SimulationClockConfig clock_config)
+    : bodies(bodies)
+    , routine(routine)
+    , clock(clock_config)
+    , tick_seconds(clock.tick_seconds()) {
+    // the initial state, so the first acquire_frame() already has bodies
+    remember_positions();
+    publish(0, clock.tick_time(0));
+    acquire_frame();
+    thread = std::thread([this] { run(); });
+}
+
+SimulationThread::~SimulationThread() {
+    stopping.store(true, std::memory_order_relaxed);
+    thread.join();
+}
+
+void SimulationThread::remember_positions() {
+    auto count = bodies.get_count();
+    last_positions.assign(bodies.get_positions().begin(), bodies.get_positions().begin() + count);
+    last_ids.assign(bodies.get_ids().begin(), bodies.get_ids().begin() + count);
+}
+
+void SimulationThread::publish(uint64_t step, SimulationClock::clock::time_point time) {
+    PROFILE_SCOPE("frame_publish");
+    auto& frame = frames.back();
+    auto count = bodies.get_count();
+    frame.positions.assign(bodies.get_positions().begin(), bodies.get_positions().begin() + count);
+    frame.radii.assign(bodies.get_radii().begin(), bodies.get_radii().begin() + count);
+    // bodies merged away in the last step are dropped, a survivor starts
+    // from where its id was
+    frame.previous_positions = frame.positions;
+    for(size_t slot = 0; slot < last_ids.size(); ++slot) {
+        if(bodies.contains(last_ids[slot]))
+            frame.previous_positions[bodies.get_slot(last_ids[slot])] = last_positions[slot];
+    }
+    frame.count = count;
+    frame.step = step;
+    frame.time = time;
+    frames.publish();
+}
+
+void SimulationThread::run() {
+    while(!stopping.load(std::memory_order_relaxed)) {
+        auto batch = clock.due();
+        if(batch == 0) {
+            clock.wait_for_next_tick();
+            continue;
+        }
+        // no hand-over between the steps of a batch
+        for(size_t k = 0; k < batch; ++k) {
+            if(k + 1 == batch)
+                remember_positions();
+            routine.compute();
+        }
+        auto step = steps.fetch_add(batch, std::memory_order_relaxed) + batch;
+        publish(step, clock.tick_time(clock.get_ticks()));
+    }
+}
+
+bool SimulationThread::acquire_frame() {
+    return frames.acquire();
+}
+
+const BodyFrame& SimulationThread::frame() const {
+    return frames.front();
+}
+
+float SimulationThread::interpolation() const {
+    if(tick_seconds == 0.0)
+        return 1.0f;
+    auto since = std::chrono::duration<double>(SimulationClock::clock::now() - frame().time).count();
+    return float(std::clamp(since / tick_seconds, 0.0, 1.0));
+}
+
+uint64_t SimulationThread::get_steps() const {
+    return steps.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Bodies.hpp"
+#include "ComputeRoutine.hpp"
+#include "SimulationClock.hpp"
+#include "TripleBuffer.hpp"
+
+// what the renderer needs of the last step of a batch
+struct BodyFrame {
+    std::vector<glm::vec4> positions;
+    // one step earlier, in the slots of positions, for interpolation
+    std::vector<glm::vec4> previous_positions;
+    std::vector<float> radii;
+    size_t count = 0;
+    uint64_t step = 0;
+    // wall time the step was due at
+    SimulationClock::clock::time_point time;
+};
+
+// Runs routine.compute() on its own thread at the rate of a SimulationClock,
+// in batches of up to max_steps_per_batch steps, and publishes the state
+// after each batch into a triple buffer. A render loop on another thread
+// always finds the latest complete frame without taking a lock. The bodies
+// and the routine belong to the simulation thread until it is destroyed.
+class SimulationThread {
+    Bodies& bodies;
+    ComputeRoutine& routine;
+    SimulationClock clock;
+    double tick_seconds;
+    TripleBuffer<BodyFrame> frames;
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> steps{0};
+    std::vector<glm::vec4> last_positions;
+    std::vector<BodyId> last_ids;
+    std::thread thread;
+
+    void remember_positions();
+    void publish(uint64_t step, SimulationClock::clock::time_point time);
+    void run();
+public:
+    SimulationThread(Bodies& bodies, ComputeRoutine& routine, SimulationClockConfig clock_config = {});
+    ~SimulationThread();
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    // reader side: true if a newer frame than the current one was taken
+    bool acquire_frame();
+    const BodyFrame& frame() const;
+    // weight of frame().positions against previous_positions for drawing
+    // now, one step behind the simulation; 1 when free running
+    float interpolation() const;
+    uint64_t get_steps() const;
+};
@@ -0,0 +1,245 @@
+#include "Snapshot.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Utils.hpp"
+
+namespace {
+uint64_t align_up(uint64_t offset) {
+    return div_ceil(offset, SnapshotHeader::alignment) * SnapshotHeader::alignment;
+}
+
+// empty blocks take no space and sit at offset 0
+SnapshotBlock next_block(uint64_t& offset, uint64_t bytes) {
+    if(bytes == 0)
+        return {0, 0};
+    SnapshotBlock block{align_up(offset), bytes};
+    offset = block.offset + bytes;
+    return block;
+}
+
+void write_block(std::ofstream& out, const SnapshotBlock& block, const void* data) {
+    static const std::vector<char> zeros(SnapshotHeader::alignment, 0);
+    if(block.bytes == 0)
+        return;
+    out.write(zeros.data(), std::streamsize(block.offset - uint64_t(out.tellp())));
+    out.write(static_cast<const char*>(data), std::streamsize(block.bytes));
+}
+
+// integrator arrays are either empty or one entry per body
+template<typename T>
+uint64_t state_bytes(const std::vector<T>& values, size_t count) {
+    if(!values.empty() && values.size() != count)
+        throw std::runtime_error("snapshot: integrator state does not match the bodies");
+    return values.size() * sizeof(T);
+}
+
+bool sync_path(const std::filesystem::path& path) {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+    auto synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+}
+
+void save_snapshot(const Bodies& bodies, const std::string& path, const SimulationState& state) {
+    auto count = bodies.get_count();
+    auto& integrator = state.integrator;
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SnapshotHeader::expected_magic, sizeof(header.magic));
+    header.version = SnapshotHeader::current_version;
+    header.byte_order = SnapshotHeader::expected_byte_order;
+    header.count = count;
+    header.radius_max = bodies.get_radius_max();
+    header.time = state.time;
+    header.step = state.step;
+    header.scheme = uint32_t(integrator.config.scheme);
+    header.dt = integrator.config.dt;
+    header.block_levels = integrator.config.block_levels;
+    header.eta = integrator.config.eta;
+    header.integrator_valid = integrator.valid;
+
+    uint64_t offset = sizeof(SnapshotHeader);
+    header.positions = next_block(offset, count * sizeof(glm::vec4));
+    header.velocities = next_block(offset, count * sizeof(glm::vec4));
+    header.masses = next_block(offset, count * sizeof(float));
+    header.radii = next_block(offset, count * sizeof(float));
+    header.accelerations = next_block(offset, state_bytes(integrator.accelerations, count));
+    header.jerks = next_block(offset, state_bytes(integrator.jerks, count));
+    header.levels = next_block(offset, state_bytes(integrator.levels, count));
+
+    auto tmp_path = path + ".tmp";
+    try {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        write_block(out, header.positions, bodies.get_positions().data());
+        write_block(out, header.velocities, bodies.get_velocities().data());
+        write_block(out, header.masses, bodies.get_masses().data());
+        write_block(out, header.radii, bodies.get_radii().data());
+        write_block(out, header.accelerations, integrator.accelerations.data());
+        write_block(out, header.jerks, integrator.jerks.data());
+        write_block(out, header.levels, integrator.levels.data());
+        out.close();
+        if(!out)
+            throw std::runtime_error("snapshot: failed to write " + tmp_path);
+        // the data must be on disk before the rename can replace a good file
+        if(!sync_path(tmp_path))
+            throw std::runtime_error("snapshot: failed to sync " + tmp_path);
+        std::filesystem::rename(tmp_path, path);
+    } catch(...) {
+        std::error_code ignored;
+        std::filesystem::remove(tmp_path, ignored);
+        throw;
+    }
+    // makes the rename itself durable, the snapshot is complete either way
+    auto directory = std::filesystem::path(path).parent_path();
+    sync_path(directory.empty() ? "." : directory);
+}
+
+MappedSnapshot::MappedSnapshot(const std::string& path) {
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("snapshot: cannot open " + path);
+    struct stat st{};
+    if(::fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        throw std::runtime_error("snapshot: " + path + " is too small");
+    }
+    size = size_t(st.st_size);
+    data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED) {
+        data = nullptr;
+        throw std::runtime_error("snapshot: cannot map " + path);
+    }
+    ::madvise(data, size, MADV_WILLNEED);
+    try {
+        validate(path);
+    } catch(...) {
+        ::munmap(data, size);
+        throw;
+    }
+}
+
+MappedSnapshot::~MappedSnapshot() {
+    if(data)
+        ::munmap(data, size);
+}
+
+MappedSnapshot::MappedSnapshot(MappedSnapshot&& that) noexcept
+    : data(std::exchange(that.data, nullptr))
+    , size(std::exchange(that.size, 0)) {}
+
+MappedSnapshot& MappedSnapshot::operator=(MappedSnapshot&& that) noexcept {
+    std::swap(data, that.data);
+    std::swap(size, that.size);
+    return *this;
+}
+
+const SnapshotHeader& MappedSnapshot::header() const {
+    return *static_cast<const SnapshotHeader*>(data);
+}
+
+template<typename T>
+std::span<const T> MappedSnapshot::block(const SnapshotBlock& b) const {
+    return {reinterpret_cast<const T*>(static_cast<const char*>(data) + b.offset), b.bytes / sizeof(T)};
+}
+
+void MappedSnapshot::validate(const std::string& path) const {
+    auto& h = header();
+    if(std::memcmp(h.magic, SnapshotHeader::expected_magic, sizeof(h.magic)) != 0)
+        throw std::runtime_error("snapshot: " + path + " is not a snapshot");
+    if(h.version != SnapshotHeader::current_version)
+        throw std::runtime_error("snapshot: " + path + " has unsupported version " + std::to_string(h.version));
+    if(h.byte_order != SnapshotHeader::expected_byte_order)
+        throw std::runtime_error("snapshot: " + path + " has foreign byte order");
+
+    auto check = [&](const SnapshotBlock& b, size_t element_size, bool optional) {
+        if(b.offset % SnapshotHeader::alignment != 0
+           || (b.bytes != h.count * element_size && !(optional && b.bytes == 0))
+           || b.offset > size
+           || b.bytes > size - b.offset)
+            throw std::runtime_error("snapshot: " + path + " is truncated or corrupt");
+    };
+    check(h.positions, sizeof(glm::vec4), false);
+    check(h.velocities, sizeof(glm::vec4), false);
+    check(h.masses, sizeof(float), false);
+    check(h.radii, sizeof(float), false);
+    check(h.accelerations, sizeof(glm::vec4), true);
+    check(h.jerks, sizeof(glm::vec4), true);
+    check(h.levels, sizeof(uint32_t), true);
+    if(h.scheme > uint32_t(IntegrationScheme::Hermite))
+        throw std::runtime_error("snapshot: " + path + " has an unknown integration scheme");
+    if(h.block_levels > max_block_levels)
+        throw std::runtime_error("snapshot: " + path + " has more than " + std::to_string(max_block_levels) + " block levels");
+}
+
+size_t MappedSnapshot::get_count() const {
+    return header().count;
+}
+
+float MappedSnapshot::get_radius_max() const {
+    return header().radius_max;
+}
+
+std::span<const glm::vec4> MappedSnapshot::get_positions() const {
+    return block<glm::vec4>(header().positions);
+}
+
+std::span<const glm::vec4> MappedSnapshot::get_velocities() const {
+    return block<glm::vec4>(header().velocities);
+}
+
+std::span<const float> MappedSnapshot::get_masses() const {
+    return block<float>(header().masses);
+}
+
+std::span<const float> MappedSnapshot::get_radii() const {
+    return block<float>(header().radii);
+}
+
+double MappedSnapshot::get_time() const {
+    return header().time;
+}
+
+uint64_t MappedSnapshot::get_step() const {
+    return header().step;
+}
+
+IntegratorState MappedSnapshot::get_integrator_state() const {
+    auto& h = header();
+    IntegratorState state;
+    state.config.scheme = IntegrationScheme(h.scheme);
+    state.config.dt = h.dt;
+    state.config.block_levels = h.block_levels;
+    state.config.eta = h.eta;
+    state.valid = h.integrator_valid != 0;
+    auto accelerations = block<glm::vec4>(h.accelerations);
+    auto jerks = block<glm::vec4>(h.jerks);
+    auto levels = block<uint32_t>(h.levels);
+    state.accelerations.assign(accelerations.begin(), accelerations.end());
+    state.jerks.assign(jerks.begin(), jerks.end());
+    state.levels.assign(levels.begin(), levels.end());
+    return state;
+}
+
+SimulationState load_snapshot(Bodies& bodies, const std::string& path) {
+    MappedSnapshot snapshot(path);
+    bodies.assign(snapshot.get_positions(),
+                  snapshot.get_velocities(),
+                  snapshot.get_masses(),
+                  snapshot.get_radii());
+    return {snapshot.get_time(), snapshot.get_step(), snapshot.get_integrator_state()};
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <glm/glm.hpp>
+
+#include "Bodies.hpp"
+#include "Integrator.hpp"
+
+// Snapshot file layout, little endian:
+//   SnapshotHeader
+//   positions      count * vec4
+//   velocities     count * vec4
+//   masses         count * float
+//   radii          count * float
+//   accelerations  count * vec4 or empty
+//   jerks          count * vec4 or empty
+//   levels         count * uint32 or empty
+// The last three are the integrator state, empty when the scheme does not
+// keep them or they are not valid yet. Every array starts on a page boundary,
+// so a mapped file can be read in place with aligned vector loads. Errors
+// throw std::runtime_error.
+struct SnapshotBlock {
+    uint64_t offset;
+    uint64_t bytes;
+};
+
+struct SnapshotHeader {
+    static constexpr char expected_magic[8] = {'G', 'R', 'A', 'V', 'S', 'N', 'A', 'P'};
+    static constexpr uint32_t current_version = 2;
+    static constexpr uint32_t expected_byte_order = 0x01020304;
+    static constexpr uint64_t alignment = 4096;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t count;
+    float radius_max;
+    uint32_t reserved;
+    double time;
+    uint64_t step;
+    uint32_t scheme;
+    float dt;
+    uint32_t block_levels;
+    float eta;
+    uint32_t integrator_valid;
+    uint32_t reserved_integrator;
+    SnapshotBlock positions;
+    SnapshotBlock velocities;
+    SnapshotBlock masses;
+    SnapshotBlock radii;
+    SnapshotBlock accelerations;
+    SnapshotBlock jerks;
+    SnapshotBlock levels;
+};
+
+// Everything besides the bodies a run needs to continue exactly where the
+// snapshot was taken.
+struct SimulationState {
+    double time = 0.0;
+    uint64_t step = 0;
+    IntegratorState integrator;
+};
+
+// Read-only view of a snapshot file mapped into memory, nothing is copied.
+class MappedSnapshot {
+    void* data = nullptr;
+    size_t size = 0;
+
+    const SnapshotHeader& header() const;
+    template<typename T>
+    std::span<const T> block(const SnapshotBlock& b) const;
+    void validate(const std::string& path) const;
+public:
+    explicit MappedSnapshot(const std::string& path);
+    ~MappedSnapshot();
+    MappedSnapshot(MappedSnapshot&& that) noexcept;
+    MappedSnapshot& operator=(MappedSnapshot&& that) noexcept;
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+    size_t get_count() const;
+    float get_radius_max() const;
+    std::span<const glm::vec4> get_positions() const;
+    std::span<const glm::vec4> get_velocities() const;
+    std::span<const float> get_masses() const;
+    std::span<const float> get_radii() const;
+    double get_time() const;
+    uint64_t get_step() const;
+    // the integrator state with its arrays copied out of the mapping
+    IntegratorState get_integrator_state() const;
+};
+
+// Written to path + ".tmp", synced and renamed, so an interrupted save keeps
+// the old file. A failed save removes the temporary file.
+void save_snapshot(const Bodies& bodies, const std::string& path, const SimulationState& state = {});
+
+// maps the file and copies each array into bodies in one go
+SimulationState load_snapshot(Bodies& bodies, const std::string& path);
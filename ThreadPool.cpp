@@ -0,0 +1,120 @@
+#include "ThreadPool.hpp"
+
+namespace {
+thread_local bool inside_job = false;
+thread_local size_t current_worker = 0;
+
+constexpr size_t spin_limit = 1 << 14;
+
+void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+}
+
+ThreadPool::ThreadPool(size_t thread_count)
+    : thread_count(std::max<size_t>(1, thread_count))
+    , slices(new Slice[this->thread_count]) {
+    for(size_t worker_id = 1; worker_id < this->thread_count; ++worker_id)
+        workers.emplace_back(&ThreadPool::worker_loop, this, worker_id);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+        generation.fetch_add(1);
+    }
+    cv.notify_all();
+    for(auto& w : workers)
+        w.join();
+}
+
+size_t ThreadPool::size() const {
+    return thread_count;
+}
+
+void ThreadPool::worker_loop(size_t worker_id) {
+    uint64_t seen = 0;
+    while(true) {
+        auto gen = generation.load(std::memory_order_acquire);
+        for(size_t spin = 0; gen == seen && spin < spin_limit; ++spin) {
+            if(spin % 64 == 63)
+                std::this_thread::yield();
+            else
+                cpu_relax();
+            gen = generation.load(std::memory_order_acquire);
+        }
+        if(gen == seen) {
+            std::unique_lock lock(mutex);
+            sleeping.fetch_add(1);
+            cv.wait(lock, [&] {
+                gen = generation.load();
+                return gen != seen;
+            });
+            sleeping.fetch_sub(1);
+        }
+        if(stopping)
+            return;
+        seen = gen;
+        run_job(worker_id);
+        pending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+void ThreadPool::run_job(size_t worker_id) {
+    inside_job = true;
+    current_worker = worker_id;
+    for(size_t i = 0; i < thread_count; ++i) {
+        auto& slice = slices[(worker_id + i) % thread_count];
+        while(true) {
+            auto chunk = slice.next.fetch_add(1, std::memory_order_relaxed);
+            if(chunk >= slice.end)
+                break;
+            auto begin = job_begin + chunk * job_grain;
+            job_invoke(job_ctx, begin, std::min(job_end, begin + job_grain), worker_id);
+        }
+    }
+    inside_job = false;
+}
+
+void ThreadPool::dispatch(invoke_t invoke, void* ctx, size_t begin, size_t end, size_t grain) {
+    if(end <= begin)
+        return;
+    grain = std::max<size_t>(1, grain);
+    auto chunks = (end - begin + grain - 1) / grain;
+
+    if(thread_count == 1 || chunks == 1 || inside_job) {
+        for(auto b = begin; b < end; b += grain)
+            invoke(ctx, b, std::min(end, b + grain), current_worker);
+        return;
+    }
+
+    job_invoke = invoke;
+    job_ctx = ctx;
+    job_begin = begin;
+    job_end = end;
+    job_grain = grain;
+    auto per_worker = (chunks + thread_count - 1) / thread_count;
+    for(size_t w = 0; w < thread_count; ++w) {
+        slices[w].next.store(std::min(chunks, w * per_worker), std::memory_order_relaxed);
+        slices[w].end = std::min(chunks, (w + 1) * per_worker);
+    }
+    pending.store(thread_count - 1, std::memory_order_relaxed);
+
+    generation.fetch_add(1);
+    if(sleeping.load() > 0) {
+        { std::lock_guard lock(mutex); }
+        cv.notify_all();
+    }
+
+    run_job(0);
+    current_worker = 0;
+    for(size_t spin = 0; pending.load(std::memory_order_acquire) != 0; ++spin) {
+        if(spin % 64 == 63)
+            std::this_thread::yield();
+        else
+            cpu_relax();
+    }
+}
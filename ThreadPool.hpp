@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Persistent pool for fork-join loops. The calling thread takes part as
+// worker 0. A range is cut into grain-sized chunks, every worker starts on
+// its own contiguous slice of chunks and steals from the other slices once
+// it runs out. Workers spin for a short while between jobs before going to
+// sleep, so back-to-back phases of a step do not pay for a wake-up.
+// parallel_for called from inside a running job executes inline.
+class ThreadPool {
+    struct alignas(64) Slice {
+        std::atomic<size_t> next{0};
+        size_t end{0};
+    };
+
+    using invoke_t = void (*)(void*, size_t, size_t, size_t);
+
+    size_t thread_count;
+    std::vector<std::thread> workers;
+    std::unique_ptr<Slice[]> slices;
+
+    invoke_t job_invoke = nullptr;
+    void* job_ctx = nullptr;
+    size_t job_begin = 0;
+    size_t job_end = 0;
+    size_t job_grain = 1;
+
+    std::atomic<uint64_t> generation{0};
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> sleeping{0};
+    std::atomic<bool> stopping{false};
+    std::mutex mutex;
+    std::condition_variable cv;
+
+    void worker_loop(size_t worker_id);
+    void run_job(size_t worker_id);
+    void dispatch(invoke_t invoke, void* ctx, size_t begin, size_t end, size_t grain);
+public:
+    explicit ThreadPool(size_t thread_count = std::thread::hardware_concurrency());
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const;
+
+    // fn(chunk_begin, chunk_end) or fn(chunk_begin, chunk_end, worker_id)
+    template<typename F>
+    void parallel_for(size_t begin, size_t end, size_t grain, F&& fn) {
+        auto invoke = [](void* ctx, size_t b, size_t e, size_t worker_id) {
+            auto& f = *static_cast<std::remove_reference_t<F>*>(ctx);
+            if constexpr (std::is_invocable_v<F&, size_t, size_t, size_t>)
+                f(b, e, worker_id);
+            else
+                f(b, e);
+        };
+        dispatch(invoke, (void*)std::addressof(fn), begin, end, grain);
+    }
+
+    template<typename F>
+    void parallel_for(size_t begin, size_t end, F&& fn) {
+        auto count = end > begin ? end - begin : 0;
+        auto grain = std::max<size_t>(1, count / (thread_count * 8));
+        parallel_for(begin, end, grain, std::forward<F>(fn));
+    }
+};
+
+// Exclusive prefix sum in two passes over fixed blocks: write(i, value(0) +
+// ... + value(i - 1)) for every i in [0, count). Returns the total.
+template<typename VALUE, typename WRITE>
+size_t parallel_exclusive_scan(ThreadPool& pool, size_t count, VALUE&& value, WRITE&& write) {
+    auto blocks = std::min(count, pool.size() * 4);
+    if(blocks == 0)
+        return 0;
+    auto block_size = (count + blocks - 1) / blocks;
+    std::vector<size_t> block_sums(blocks + 1, 0);
+    pool.parallel_for(0, blocks, 1, [&](size_t begin, size_t end) {
+        for(auto block = begin; block < end; ++block) {
+            size_t sum = 0;
+            for(auto i = block * block_size; i < std::min(count, (block + 1) * block_size); ++i)
+                sum += value(i);
+            block_sums[block + 1] = sum;
+        }
+    });
+    for(size_t block = 0; block < blocks; ++block)
+        block_sums[block + 1] += block_sums[block];
+    pool.parallel_for(0, blocks, 1, [&](size_t begin, size_t end) {
+        for(auto block = begin; block < end; ++block) {
+            auto sum = block_sums[block];
+            for(auto i = block * block_size; i < std::min(count, (block + 1) * block_size); ++i) {
+                auto v = value(i);
+                write(i, sum);
+                sum += v;
+            }
+        }
+    });
+    return block_sums[blocks];
+}
+
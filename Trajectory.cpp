@@ -0,0 +1,331 @@
+#include "Trajectory.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+constexpr char trajectory_magic[8] = {'G', 'R', 'A', 'V', 'T', 'R', 'A', 'J'};
+constexpr uint32_t trajectory_version = 1;
+constexpr uint32_t trajectory_byte_order = 0x01020304;
+
+enum FrameKind : uint8_t {
+    Keyframe = 0,
+    DeltaFrame = 1
+};
+
+template<typename T>
+void put(std::vector<uint8_t>& bytes, const T& value) {
+    auto p = reinterpret_cast<const uint8_t*>(&value);
+    bytes.insert(bytes.end(), p, p + sizeof(T));
+}
+
+template<typename T>
+T get(const uint8_t*& p, const uint8_t* end) {
+    if(size_t(end - p) < sizeof(T))
+        throw std::runtime_error("trajectory: truncated frame");
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+}
+
+void put_varint(std::vector<uint8_t>& bytes, uint32_t value) {
+    while(value >= 0x80) {
+        bytes.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(uint8_t(value));
+}
+
+uint32_t get_varint(const uint8_t*& p, const uint8_t* end) {
+    uint32_t value = 0;
+    for(int shift = 0; shift < 35; shift += 7) {
+        if(p == end)
+            throw std::runtime_error("trajectory: truncated frame");
+        auto byte = *p++;
+        value |= uint32_t(byte & 0x7f) << shift;
+        if(!(byte & 0x80))
+            return value;
+    }
+    throw std::runtime_error("trajectory: bad varint");
+}
+
+uint32_t zigzag(int32_t value) {
+    return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value) {
+    return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+// slots of previous that are missing from current, false if current is not
+// previous with some bodies removed (new bodies or a reordering)
+bool removed_ids(const std::vector<BodyId>& previous,
+                 const std::vector<BodyId>& current,
+                 std::vector<uint32_t>& removed) {
+    removed.clear();
+    if(current.size() > previous.size())
+        return false;
+    size_t j = 0;
+    for(auto id : current) {
+        while(j < previous.size() && previous[j] != id)
+            removed.push_back(uint32_t(j++));
+        if(j == previous.size())
+            return false;
+        ++j;
+    }
+    for(; j < previous.size(); ++j)
+        removed.push_back(uint32_t(j));
+    return true;
+}
+
+template<typename T>
+void write_raw(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool read_raw(std::istream& in, T& value) {
+    return bool(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::string& path, TrajectoryConfig config)
+    : config(config)
+    , out(path, std::ios::binary | std::ios::trunc)
+    , slots(std::max<size_t>(1, config.queue_frames)) {
+    if(!out)
+        throw std::runtime_error("trajectory: cannot open " + path);
+    this->config.bits = std::clamp<uint32_t>(config.bits, 1, 24);
+    out.write(trajectory_magic, sizeof(trajectory_magic));
+    write_raw(out, trajectory_version);
+    write_raw(out, trajectory_byte_order);
+    write_raw(out, this->config.bits);
+    write_raw(out, uint32_t(0));
+    thread = std::thread([this] { run(); });
+}
+
+TrajectoryWriter::~TrajectoryWriter() {
+    close();
+}
+
+void TrajectoryWriter::close() {
+    if(!thread.joinable())
+        return;
+    stopping.store(true, std::memory_order_release);
+    signal.fetch_add(1, std::memory_order_release);
+    signal.notify_one();
+    thread.join();
+}
+
+bool TrajectoryWriter::push(const Bodies& bodies, uint64_t step) {
+    auto t = tail.load(std::memory_order_relaxed);
+    if(t - head.load(std::memory_order_acquire) == slots.size()) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    auto& frame = slots[t % slots.size()];
+    auto count = bodies.get_count();
+    frame.step = step;
+    frame.positions.assign(bodies.get_positions().begin(), bodies.get_positions().begin() + count);
+    frame.ids.assign(bodies.get_ids().begin(), bodies.get_ids().begin() + count);
+    tail.store(t + 1, std::memory_order_release);
+    signal.fetch_add(1, std::memory_order_release);
+    signal.notify_one();
+    return true;
+}
+
+size_t TrajectoryWriter::get_dropped() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+size_t TrajectoryWriter::get_written() const {
+    return written.load(std::memory_order_relaxed);
+}
+
+bool TrajectoryWriter::has_failed() const {
+    return failed.load(std::memory_order_acquire);
+}
+
+void TrajectoryWriter::run() {
+    while(true) {
+        auto s = signal.load(std::memory_order_acquire);
+        auto h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_acquire)) {
+            if(stopping.load(std::memory_order_acquire))
+                break;
+            signal.wait(s, std::memory_order_acquire);
+            continue;
+        }
+        if(!failed.load(std::memory_order_relaxed)) {
+            write(slots[h % slots.size()]);
+            if(out)
+                written.fetch_add(1, std::memory_order_relaxed);
+            else
+                failed.store(true, std::memory_order_release);
+        }
+        head.store(h + 1, std::memory_order_release);
+    }
+    out.close();
+    if(!out)
+        failed.store(true, std::memory_order_release);
+}
+
+// false if a body left the box
+bool TrajectoryWriter::quantize(const TrajectoryFrame& frame) {
+    auto levels = float((1u << config.bits) - 1);
+    quantized.resize(frame.positions.size() * 3);
+    for(size_t i = 0; i < frame.positions.size(); ++i) {
+        auto q = glm::floor((glm::vec3(frame.positions[i]) - box_min) * box_scale + glm::vec3(0.5f));
+        for(int axis = 0; axis < 3; ++axis) {
+            if(!(q[axis] >= 0.0f && q[axis] <= levels))
+                return false;
+            quantized[i * 3 + axis] = uint32_t(q[axis]);
+        }
+    }
+    return true;
+}
+
+void TrajectoryWriter::start_key(const TrajectoryFrame& frame) {
+    glm::vec3 lo{std::numeric_limits<float>::max()};
+    glm::vec3 hi{std::numeric_limits<float>::lowest()};
+    for(auto& p : frame.positions) {
+        lo = glm::min(lo, glm::vec3(p));
+        hi = glm::max(hi, glm::vec3(p));
+    }
+    if(frame.positions.empty())
+        lo = hi = glm::vec3(0.0f);
+    // relative to the widest axis, a flat disk still gets room to thicken
+    auto extent = hi - lo;
+    auto widest = std::max({extent.x, extent.y, extent.z});
+    auto pad = glm::vec3(widest * config.box_margin)
+             + glm::vec3(1e-6f) * glm::max(glm::vec3(1.0f), glm::max(glm::abs(lo), glm::abs(hi)));
+    box_min = lo - pad;
+    box_scale = glm::vec3(float((1u << config.bits) - 1)) / (hi + pad - box_min);
+}
+
+void TrajectoryWriter::write(const TrajectoryFrame& frame) {
+    auto count = frame.positions.size();
+    bool key = !has_key
+            || (config.keyframe_interval && frames_since_key >= config.keyframe_interval)
+            || !removed_ids(previous_ids, frame.ids, removed)
+            || !quantize(frame);
+    payload.clear();
+    if(key) {
+        start_key(frame);
+        quantize(frame);
+        put(payload, box_min);
+        put(payload, box_scale);
+        for(auto id : frame.ids) {
+            put(payload, id.index);
+            put(payload, id.generation);
+        }
+        for(auto q : quantized)
+            put_varint(payload, q);
+        frames_since_key = 0;
+        has_key = true;
+    } else {
+        put_varint(payload, uint32_t(removed.size()));
+        uint32_t last = 0;
+        for(auto slot : removed) {
+            put_varint(payload, slot - last);
+            last = slot;
+        }
+        auto next_removed = removed.begin();
+        for(size_t slot = 0, k = 0; slot < previous_ids.size(); ++slot) {
+            if(next_removed != removed.end() && *next_removed == slot) {
+                ++next_removed;
+                continue;
+            }
+            for(int axis = 0; axis < 3; ++axis, ++k)
+                put_varint(payload, zigzag(int32_t(quantized[k] - previous[slot * 3 + axis])));
+        }
+    }
+    previous.swap(quantized);
+    previous_ids = frame.ids;
+    ++frames_since_key;
+
+    write_raw(out, uint8_t(key ? Keyframe : DeltaFrame));
+    write_raw(out, uint64_t(frame.step));
+    write_raw(out, uint64_t(count));
+    write_raw(out, uint64_t(payload.size()));
+    out.write(reinterpret_cast<const char*>(payload.data()), std::streamsize(payload.size()));
+}
+
+TrajectoryReader::TrajectoryReader(const std::string& path)
+    : in(path, std::ios::binary) {
+    char magic[8];
+    uint32_t version, byte_order, reserved;
+    if(!in.read(magic, sizeof(magic))
+       || std::memcmp(magic, trajectory_magic, sizeof(magic)) != 0
+       || !read_raw(in, version) || !read_raw(in, byte_order)
+       || !read_raw(in, bits) || !read_raw(in, reserved))
+        throw std::runtime_error("trajectory: " + path + " is not a trajectory");
+    if(version != trajectory_version || byte_order != trajectory_byte_order || bits == 0 || bits > 24)
+        throw std::runtime_error("trajectory: " + path + " has an unsupported format");
+}
+
+bool TrajectoryReader::next(TrajectoryFrame& frame) {
+    uint8_t kind;
+    if(!read_raw(in, kind))
+        return false;
+    uint64_t step, count, bytes;
+    if(!read_raw(in, step) || !read_raw(in, count) || !read_raw(in, bytes))
+        throw std::runtime_error("trajectory: truncated frame");
+    payload.resize(bytes);
+    if(!in.read(reinterpret_cast<char*>(payload.data()), std::streamsize(bytes)))
+        throw std::runtime_error("trajectory: truncated frame");
+
+    const uint8_t* p = payload.data();
+    const uint8_t* end = p + payload.size();
+    if(kind == Keyframe) {
+        box_min = get<glm::vec3>(p, end);
+        box_scale = get<glm::vec3>(p, end);
+        previous_ids.resize(count);
+        for(auto& id : previous_ids) {
+            id.index = get<uint32_t>(p, end);
+            id.generation = get<uint32_t>(p, end);
+        }
+        previous.resize(count * 3);
+        for(auto& q : previous)
+            q = get_varint(p, end);
+    } else if(kind == DeltaFrame) {
+        auto removed_count = get_varint(p, end);
+        if(previous_ids.size() < removed_count || count != previous_ids.size() - removed_count)
+            throw std::runtime_error("trajectory: delta frame without matching keyframe");
+        removed.resize(removed_count);
+        for(size_t k = 0; k < removed_count; ++k) {
+            removed[k] = (k ? removed[k - 1] : 0) + get_varint(p, end);
+            if((k && removed[k] <= removed[k - 1]) || removed[k] >= previous_ids.size())
+                throw std::runtime_error("trajectory: bad removal list");
+        }
+        size_t kept = 0;
+        auto next_removed = removed.begin();
+        for(size_t slot = 0; slot < previous_ids.size(); ++slot) {
+            if(next_removed != removed.end() && *next_removed == slot) {
+                ++next_removed;
+                continue;
+            }
+            previous_ids[kept] = previous_ids[slot];
+            for(int axis = 0; axis < 3; ++axis)
+                previous[kept * 3 + axis] = previous[slot * 3 + axis] + uint32_t(unzigzag(get_varint(p, end)));
+            ++kept;
+        }
+        previous_ids.resize(kept);
+        previous.resize(kept * 3);
+    } else {
+        throw std::runtime_error("trajectory: unknown frame kind");
+    }
+
+    frame.step = step;
+    frame.ids = previous_ids;
+    frame.positions.resize(count);
+    for(size_t i = 0; i < count; ++i) {
+        glm::vec3 q{float(previous[i * 3]), float(previous[i * 3 + 1]), float(previous[i * 3 + 2])};
+        frame.positions[i] = glm::vec4(box_min + q / box_scale, 1.0f);
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Bodies.hpp"
+
+// Trajectory file: a header followed by frame records. A keyframe stores the
+// quantization box, the body ids and the quantized positions. A delta frame
+// stores only the change of every quantized coordinate since the previous
+// frame, zigzag varint encoded, so slow bodies cost a byte per axis, after
+// the list of slots removed since then (merged bodies). Deltas need the
+// previous ids in the same order minus the removed ones and every body inside
+// the keyframe box, anything else starts a new keyframe.
+
+struct TrajectoryConfig {
+    // bits per quantized coordinate, at most 24
+    uint32_t bits = 16;
+    // frames between forced keyframes, 0 writes keyframes only when needed
+    uint32_t keyframe_interval = 64;
+    // frames the simulation can run ahead of the writer before frames drop
+    size_t queue_frames = 4;
+    // the keyframe box is the bounding box grown on every side by this
+    // fraction of its widest extent
+    float box_margin = 0.1f;
+};
+
+struct TrajectoryFrame {
+    // steps simulated up to this frame, the step a snapshot of it records
+    uint64_t step = 0;
+    std::vector<glm::vec4> positions;
+    std::vector<BodyId> ids;
+};
+
+// Frames go from the simulation thread to a background thread through a
+// single-producer single-consumer ring. push() copies the positions and ids
+// into a free slot and never waits: with the ring full the frame is
+// dropped and counted. close() or the destructor writes the queued frames
+// and joins. After a failed write the writer stops writing and only drains
+// the ring.
+class TrajectoryWriter {
+    TrajectoryConfig config;
+    std::ofstream out;
+    std::vector<TrajectoryFrame> slots;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<uint32_t> signal{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<size_t> dropped{0};
+    std::atomic<size_t> written{0};
+    std::atomic<bool> failed{false};
+
+    glm::vec3 box_min{0.0f};
+    glm::vec3 box_scale{0.0f};
+    std::vector<uint32_t> previous;
+    std::vector<BodyId> previous_ids;
+    uint32_t frames_since_key = 0;
+    bool has_key = false;
+    std::vector<uint32_t> quantized;
+    std::vector<uint32_t> removed;
+    std::vector<uint8_t> payload;
+
+    std::thread thread;
+
+    void run();
+    bool quantize(const TrajectoryFrame& frame);
+    void start_key(const TrajectoryFrame& frame);
+    void write(const TrajectoryFrame& frame);
+public:
+    TrajectoryWriter(const std::string& path, TrajectoryConfig config = {});
+    ~TrajectoryWriter();
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    // false if the frame was dropped
+    bool push(const Bodies& bodies, uint64_t step);
+    // writes the queued frames, closes the file and joins, push() must not
+    // be called afterwards
+    void close();
+    size_t get_dropped() const;
+    size_t get_written() const;
+    // a write or the final flush failed, the file is incomplete
+    bool has_failed() const;
+};
+
+class TrajectoryReader {
+    std::ifstream in;
+    uint32_t bits = 0;
+    glm::vec3 box_min{0.0f};
+    glm::vec3 box_scale{0.0f};
+    std::vector<uint32_t> previous;
+    std::vector<BodyId> previous_ids;
+    std::vector<uint32_t> removed;
+    std::vector<uint8_t> payload;
+public:
+    explicit TrajectoryReader(const std::string& path);
+
+    // false at the end of the file, throws std::runtime_error on bad data
+    bool next(TrajectoryFrame& frame);
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free hand-over of the latest value from one writer thread to one
+// reader thread. The writer fills back() and publishes it, the reader takes
+// the most recently published value with acquire(). Neither side ever waits,
+// values the reader did not get to in time are overwritten.
+template<typename T>
+class TripleBuffer {
+    static constexpr uint8_t fresh = 4;
+    static constexpr uint8_t index_mask = 3;
+
+    std::array<T, 3> slots;
+    uint8_t back_index = 0;
+    uint8_t front_index = 1;
+    // index of the slot between writer and reader, plus fresh once published
+    std::atomic<uint8_t> middle{2};
+public:
+    T& back() { return slots[back_index]; }
+
+    void publish() {
+        back_index = middle.exchange(back_index | fresh, std::memory_order_acq_rel) & index_mask;
+    }
+
+    // false if nothing was published since the last acquire, front() is
+    // then still the previous value
+    bool acquire() {
+        if(!(middle.load(std::memory_order_relaxed) & fresh))
+            return false;
+        front_index = middle.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+
+    const T& front() const { return slots[front_index]; }
+};
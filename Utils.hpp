@@ -85,6 +85,10 @@ struct UniquePairs {
         if(id >= size())
             return end();
         size_t row = sqrt(8.0*id + 1) / 2 + 0.5;
+        while(row * (row - 1) / 2 > id)
+            --row;
+        while(row * (row + 1) / 2 <= id)
+            ++row;
         size_t col = id - (row - 1) * row / 2;
         return {view.begin(), std::next(view.begin(), col), std::next(view.begin(), row)};
     }
@@ -1,40 +1,80 @@
+#include <fstream>
+#include <iostream>
+#include <string>
 #include <glm/gtx/transform.hpp>
 #include <gl_context/GLContext.hpp>
 #include <WindowContext/GLFWContext.hpp>
 
 #include "ViewPortController.hpp"
 #include "Renderer.hpp"
+#include "InitialConditions.hpp"
+#include "Profiler.hpp"
 
-#define _CPU_COMPUTE_ 1
-#define _CPU_GPU_COMPUTE_ 2
-#define _ROUTINE_ _CPU_GPU_COMPUTE_
-
-#if _ROUTINE_ == _CPU_COMPUTE_
 #include "CPUComputeRoutine.hpp"
-using Routine_t = CPUComputeRoutine;
-#elif _ROUTINE_ == _CPU_GPU_COMPUTE_
 #include "CPUGPUComputeRoutine.hpp"
-using Routine_t = CPUGPUComputeRoutine;
-#endif
-
-void init_bodies(Bodies& bodies, size_t num) {
-    glm::vec3 z_axis{0.0f, 0.0f, 1.0f};
-
-    for(auto i : std::views::iota((size_t)0, num)) {
-        (void)i;
-
-        auto dist = sqrt(rand_0_1<float>());
-        auto angle = rand_1_1<float>() * M_PIf;
+#include "ChunkedGPUComputeRoutine.hpp"
+#include "SimulationClock.hpp"
+#include "SimulationThread.hpp"
 
-        glm::vec4 position = (glm::rotate(angle, z_axis)
-                              * glm::vec4{dist, 0.0f, 0.0f, 1.0f}) / 1.0f;
-
-        glm::vec4 velocity{position.y, -position.x, rand_1_1<float>()/5.0f, 0.0f};
-        velocity *= dist / 2000.0f;
-        float mass = rand_0_1<float>() / 4.1f;
+struct Options {
+    // a registered routine name or auto
+    std::string routine = "cpu-gpu";
+    size_t threads = std::thread::hardware_concurrency();
+    SimulationClockConfig clock_config;
+    GravityKernelConfig kernel_config;
+    ChunkedGravityConfig chunked_config;
+    IntegratorConfig integrator_config;
+};
 
-        bodies.add(position, velocity, mass);
+bool parse_args(int argc, char** argv, Options& options) {
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(i + 1 >= argc)
+            return false;
+        std::string value = argv[++i];
+        try {
+            if(arg == "--routine")
+                options.routine = value;
+            else if(arg == "--threads")
+                options.threads = std::stoul(value);
+            else if(arg == "--tick-rate")
+                options.clock_config.tick_rate = std::stod(value);
+            else if(arg == "--steps-per-frame")
+                options.clock_config.max_steps_per_batch = std::stoul(value);
+            else if(arg == "--gpu-kernel") {
+                if(value == "simple")
+                    options.kernel_config.kernel = GravityKernel::Simple;
+                else if(value == "tiled")
+                    options.kernel_config.kernel = GravityKernel::Tiled;
+                else
+                    return false;
+            }
+            else if(arg == "--local-size")
+                options.kernel_config.local_size = std::stoul(value);
+            else if(arg == "--chunk-size")
+                options.chunked_config.chunk_size = std::stoul(value);
+            else if(arg == "--dt")
+                options.integrator_config.dt = std::stof(value);
+            else if(arg == "--block-levels")
+                options.integrator_config.block_levels = std::stoul(value);
+            else if(arg == "--integrator") {
+                if(!parse_integration_scheme(value, options.integrator_config.scheme))
+                    return false;
+            }
+            else
+                return false;
+        } catch(const std::exception&) {
+            return false;
+        }
     }
+    // an explicit CPU routine must take the integrator
+    GravitySolver solver;
+    if(options.routine.starts_with("cpu-") && parse_gravity_solver(options.routine.substr(4), solver)
+       && !solver_supports_scheme(solver, options.integrator_config.scheme))
+        return false;
+    if(options.integrator_config.block_levels > max_block_levels)
+        return false;
+    return options.threads > 0;
 }
 
 struct WindowCallbacks : io::IWindowResizeListener
@@ -59,7 +99,43 @@ struct WindowCallbacks : io::IWindowResizeListener
     }
 };
 
-int main() {
+// Runs a CPU routine in the render loop and uploads what it computed, so
+// calibration can time it against the GPU routines there.
+struct UploadingRoutine : ComputeRoutine {
+    std::unique_ptr<ComputeRoutine> routine;
+    const Bodies& bodies;
+    ArrayBufferObject &positions_out, &radii_out;
+
+    UploadingRoutine(std::unique_ptr<ComputeRoutine> routine,
+                     const Bodies& bodies,
+                     ArrayBufferObject& positions_out,
+                     ArrayBufferObject& radii_out)
+        : routine(std::move(routine))
+        , bodies(bodies)
+        , positions_out(positions_out)
+        , radii_out(radii_out) {}
+
+    void compute() override {
+        routine->compute();
+        positions_out.bind().update(bodies.get_positions(), bodies.get_count());
+        radii_out.bind().update(bodies.get_radii(), bodies.get_count());
+    }
+    Integrator* get_integrator() override { return routine->get_integrator(); }
+    void sync_bodies() override { routine->sync_bodies(); }
+    void reload_bodies() override { routine->reload_bodies(); }
+};
+
+int main(int argc, char** argv) {
+    Options options;
+    if(!parse_args(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0] << " [--routine cpu-gpu | chunked-gpu | cpu-<solver> | auto] [--threads T]\n"
+                  << "       [--tick-rate HZ (60, 0 runs free)] [--steps-per-frame K (8)]\n"
+                  << "       [--gpu-kernel simple | tiled (tiled)] [--local-size N (128)]\n"
+                  << "       [--chunk-size N (from the free device memory)]\n"
+                  << "       [--integrator euler | leapfrog | hermite (euler)] [--dt DT (1)] [--block-levels L (0)]\n";
+        return 1;
+    }
+
     auto& glfw = io::GLFWContext::get();
     GLContext::get();
 
@@ -81,9 +157,11 @@ int main() {
     glfw.set_listener(callbacks.as_key_input_listener());
     glfw.set_listener(callbacks.as_mouse_movement_listener());
 
+    ThreadPool pool(options.threads);
     Bodies bodies;
-//    init_bodies(bodies, 4096);
-    init_bodies(bodies, 1024);
+    InitialConditionsConfig ic_config;
+//    ic_config.count = 4096;
+    generate_rotating_disk(bodies, ic_config, pool);
 //    bodies.add({0.1, 0.0, 0.0, 0.0}, glm::vec4{0.0}, 1);
 //    bodies.add({-0.1, 0.0, 0.0, 0.0}, glm::vec4{0.0}, 10);
 
@@ -97,13 +175,102 @@ int main() {
     Renderer renderer(vbo_positions_render, vbo_radii_render);
 
     float G = 0.000000001f;
-    Routine_t routine(bodies, vbo_positions_render, vbo_radii_render, G);
+    auto& integrator_config = options.integrator_config;
+    // solvers that cannot take the integrator are left out
+    ComputeRoutineRegistry registry;
+    for(auto solver : gravity_solvers) {
+        if(!solver_supports_scheme(solver, integrator_config.scheme))
+            continue;
+        GravitySolverConfig gravity_config;
+        gravity_config.solver = solver;
+        registry.add(std::string("cpu-") + gravity_solver_name(solver), [&, gravity_config] {
+            return std::make_unique<CPUComputeRoutine>(bodies, G, gravity_config, integrator_config, pool);
+        });
+    }
+
+    // The GPU routines need this thread's GL context, so they stay in the
+    // render loop; the CPU routines run on the simulation thread. auto times
+    // the CPU routines against cpu-gpu, so it runs in the render loop too.
+    ComputeRoutineRegistry gl_registry;
+    gl_registry.add("cpu-gpu", [&] {
+        return std::make_unique<CPUGPUComputeRoutine>(bodies,
+                                                      vbo_positions_render,
+                                                      vbo_radii_render,
+                                                      G,
+                                                      integrator_config,
+                                                      pool,
+                                                      options.kernel_config);
+    });
+    gl_registry.add("chunked-gpu", [&] {
+        return std::make_unique<ChunkedGPUComputeRoutine>(bodies,
+                                                          vbo_positions_render,
+                                                          vbo_radii_render,
+                                                          G,
+                                                          integrator_config,
+                                                          pool,
+                                                          options.chunked_config);
+    });
+    ComputeRoutineRegistry auto_registry;
+    if(CPUGPUComputeRoutine::is_supported() && integrator_config.block_levels == 0)
+        auto_registry.add("cpu-gpu", [&] { return gl_registry.create("cpu-gpu"); });
+    for(auto& name : registry.names())
+        auto_registry.add(name, [&, name] {
+            return std::make_unique<UploadingRoutine>(registry.create(name), bodies, vbo_positions_render, vbo_radii_render);
+        });
+
+    std::unique_ptr<ComputeRoutine> gl_routine;
+    std::unique_ptr<ComputeRoutine> routine;
+    try {
+        if(options.routine == "auto")
+            gl_routine = std::make_unique<CalibratingRoutine>(auto_registry, bodies);
+        else if(gl_registry.contains(options.routine))
+            gl_routine = gl_registry.create(options.routine);
+        else
+            routine = registry.create(options.routine);
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    // from here on bodies belong to the simulation thread, the render loop
+    // only sees the frames it publishes
+    std::unique_ptr<SimulationThread> simulation;
+    if(routine)
+        simulation = std::make_unique<SimulationThread>(bodies, *routine, options.clock_config);
+    SimulationClock gl_clock(options.clock_config);
+    std::vector<glm::vec4> interpolated;
+    bool showing_interpolated = false;
 
     glfw.update();
     std::tie(width, height) = glfw.get_dimensions();
     callbacks.resize_callback(width, height);
     while(glfw.update()) {
-        routine.compute();
+        size_t count;
+        if(simulation) {
+            auto fresh = simulation->acquire_frame();
+            auto& frame = simulation->frame();
+            auto alpha = simulation->interpolation();
+            PROFILE_SCOPE("frame_upload");
+            if(fresh)
+                vbo_radii_render.bind().update(frame.radii, frame.count);
+            if(alpha < 1.0f) {
+                interpolated.resize(frame.count);
+                for(size_t i = 0; i < frame.count; ++i)
+                    interpolated[i] = glm::mix(frame.previous_positions[i], frame.positions[i], alpha);
+                vbo_positions_render.bind().update(interpolated, frame.count);
+                showing_interpolated = true;
+            } else if(fresh || showing_interpolated) {
+                vbo_positions_render.bind().update(frame.positions, frame.count);
+                showing_interpolated = false;
+            }
+            count = frame.count;
+        } else {
+            // the render loop routines write straight into the render
+            // buffers, so they run their batches here without interpolation
+            for(auto batch = gl_clock.due(); batch > 0; --batch)
+                gl_routine->compute();
+            count = bodies.get_count();
+        }
 
         glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
@@ -111,8 +278,14 @@ int main() {
         glViewport(0, 0, width, height);
 
         vp_ctl.apply_movement();
-        renderer.render(bodies.get_count(), vp.get_matrix(), vp.position);
+        renderer.render(count, vp.get_matrix(), vp.position);
     }
+    simulation.reset();
 
+#ifdef GRAVITY_PROFILING
+    std::ofstream trace("gravity_simulation_trace.json");
+    write_chrome_trace(trace);
+    write_profile_summary(std::cerr);
+#endif
     return 0;
 }
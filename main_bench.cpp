@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "CPUComputeRoutine.hpp"
+#include "ComputeCPU.hpp"
+#include "ComputeCPUFunctions.hpp"
+#include "DirectSumSimd.hpp"
+#include "InitialConditions.hpp"
+#include "PairTiling.hpp"
+#include "SimulationThread.hpp"
+
+struct BenchConfig {
+    size_t min_n = 256;
+    size_t max_n = 1 << 20;
+    // O(N^2) kernels stop here
+    size_t max_pairwise_n = 16384;
+    std::vector<size_t> threads;
+    double min_time = 0.2;
+    unsigned seed = 1;
+    std::string out;
+};
+
+struct BenchResult {
+    std::string kernel;
+    size_t n;
+    size_t threads;
+    size_t iterations;
+    double mean_ns;
+    double min_ns;
+    // work items per iteration: interactions, pairs, calls or bodies
+    double items;
+};
+
+class Bench {
+    const BenchConfig& config;
+    std::vector<BenchResult> results;
+public:
+    Bench(const BenchConfig& config) : config(config) {}
+
+    // setup() runs untimed before every run(), for kernels that consume their input
+    template<typename SETUP, typename RUN>
+    void measure(const std::string& kernel, size_t n, size_t threads, double items, SETUP&& setup, RUN&& run) {
+        using clock = std::chrono::steady_clock;
+        size_t iterations = 0;
+        double total_ns = 0.0;
+        double min_ns = std::numeric_limits<double>::max();
+        while(iterations == 0 || total_ns < config.min_time * 1e9) {
+            setup();
+            auto start = clock::now();
+            run();
+            auto ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            total_ns += ns;
+            min_ns = std::min(min_ns, ns);
+            ++iterations;
+        }
+        results.push_back({kernel, n, threads, iterations, total_ns / iterations, min_ns, items});
+        std::cerr << kernel << " n=" << n << " threads=" << threads
+                  << " mean=" << total_ns / iterations / 1e6 << "ms\n";
+    }
+
+    template<typename RUN>
+    void measure(const std::string& kernel, size_t n, size_t threads, double items, RUN&& run) {
+        measure(kernel, n, threads, items, []{}, std::forward<RUN>(run));
+    }
+
+    void write_json(std::ostream& out) const {
+        out << "{\n"
+            << "  \"simd_isa\": \"" << simd_isa_name(detect_simd_isa()) << "\",\n"
+            << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n"
+            << "  \"min_time_s\": " << config.min_time << ",\n"
+            << "  \"seed\": " << config.seed << ",\n"
+            << "  \"results\": [";
+        for(size_t i = 0; i < results.size(); ++i) {
+            auto& r = results[i];
+            out << (i ? ",\n" : "\n")
+                << "    {\"kernel\": \"" << r.kernel << "\""
+                << ", \"n\": " << r.n
+                << ", \"threads\": " << r.threads
+                << ", \"iterations\": " << r.iterations
+                << ", \"mean_ns\": " << r.mean_ns
+                << ", \"min_ns\": " << r.min_ns
+                << ", \"items_per_second\": " << r.items / (r.mean_ns * 1e-9) << "}";
+        }
+        out << "\n  ]\n}\n";
+    }
+};
+
+void print_usage(const char* name) {
+    std::cerr << "usage: " << name << " [options]\n"
+              << "  --min-n N           smallest body count (256)\n"
+              << "  --max-n N           largest body count, sizes step by 4x (1048576)\n"
+              << "  --max-pairwise-n N  largest body count for O(N^2) kernels (16384)\n"
+              << "  --threads T,T,...   thread counts (1, 2, 4, ... hardware concurrency)\n"
+              << "  --min-time S        seconds spent per measurement (0.2)\n"
+              << "  --seed X            initial conditions seed (1)\n"
+              << "  --out FILE          JSON output, stdout if not given\n";
+}
+
+bool parse_args(int argc, char** argv, BenchConfig& config) {
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--help" || arg == "-h" || i + 1 >= argc)
+            return false;
+        std::string value = argv[++i];
+        try {
+            if(arg == "--min-n")
+                config.min_n = std::stoul(value);
+            else if(arg == "--max-n")
+                config.max_n = std::stoul(value);
+            else if(arg == "--max-pairwise-n")
+                config.max_pairwise_n = std::stoul(value);
+            else if(arg == "--min-time")
+                config.min_time = std::stod(value);
+            else if(arg == "--seed")
+                config.seed = std::stoul(value);
+            else if(arg == "--out")
+                config.out = value;
+            else if(arg == "--threads") {
+                std::stringstream list(value);
+                for(std::string item; std::getline(list, item, ',');)
+                    config.threads.push_back(std::stoul(item));
+            }
+            else
+                return false;
+        } catch(const std::exception&) {
+            return false;
+        }
+    }
+    if(config.threads.empty())
+        for(size_t t = 1; t <= std::max(1u, std::thread::hardware_concurrency()); t *= 2)
+            config.threads.push_back(t);
+    return config.min_n > 1
+        && std::ranges::all_of(config.threads, [](auto t) { return t > 0; });
+}
+
+// a checksum of the forces, so the optimizer cannot drop an inlined kernel
+// whose result is otherwise unused
+void consume(const std::vector<glm::vec4>& forces) {
+    float sum = 0.0f;
+    for(auto& force : forces)
+        sum += force.x + force.y + force.z;
+    volatile float sink = sum;
+    (void)sink;
+}
+
+void bench_serial(Bench& bench, const BenchConfig& config, size_t n, Bodies& bodies) {
+    float G = 0.000000001f;
+    std::vector<uint32_t> indices(n);
+    std::iota(indices.begin(), indices.end(), 0);
+    UniquePairs pairs(indices);
+
+    if(n <= config.max_pairwise_n) {
+        bench.measure("calc_forces_serial", n, 1, n * (n - 1.0) / 2.0, [&] {
+            consume(calc_forces(bodies.get_positions(), bodies.get_masses(), n, G));
+        });
+
+        // every target against every source, so items are ordered interactions
+        SplitBodies split;
+        split.load(bodies.get_positions(), bodies.get_masses(), n);
+        std::vector<glm::vec3> acc(n);
+        for(auto isa : {SimdIsa::Scalar, SimdIsa::AVX2, SimdIsa::AVX512}) {
+            if(isa > detect_simd_isa())
+                continue;
+            bench.measure(std::string("calc_accelerations_simd_") + simd_isa_name(isa), n, 1, n * (n - 1.0), [&] {
+                calc_accelerations_simd(split, 0, n, acc.data(), isa);
+                volatile float sink = acc[n / 2].x;
+                (void)sink;
+            });
+        }
+
+        bench.measure("unique_pairs_iterate", n, 1, double(pairs.size()), [&] {
+            size_t sum = 0;
+            for(auto [a, b] : pairs)
+                sum += a ^ b;
+            volatile size_t sink = sum;
+            (void)sink;
+        });
+    }
+
+    std::mt19937_64 rng(config.seed);
+    std::vector<size_t> lookups(4096);
+    for(auto& id : lookups)
+        id = rng() % pairs.size();
+    bench.measure("unique_pairs_it_at", n, 1, double(lookups.size()), [&] {
+        size_t sum = 0;
+        for(auto id : lookups) {
+            auto [a, b] = *pairs.it_at(id);
+            sum += a ^ b;
+        }
+        volatile size_t sink = sum;
+        (void)sink;
+    });
+
+    bench.measure("bodies_add", n, 1, double(n), [&] {
+        Bodies fresh;
+        for(size_t i = 0; i < n; ++i)
+            fresh.add(bodies.get_positions()[i], bodies.get_velocities()[i], bodies.get_masses()[i]);
+    });
+}
+
+void bench_threaded(Bench& bench, const BenchConfig& config, size_t n, size_t threads, const Bodies& bodies) {
+    float G = 0.000000001f;
+    ThreadPool pool(threads);
+
+    // one chunk per worker, so the time is the fork-join overhead of a
+    // phase; it does not depend on n
+    std::vector<size_t> touched(pool.size());
+    if(n == config.min_n)
+        bench.measure("thread_pool_dispatch", n, threads, 1.0, [&] {
+            pool.parallel_for(0, pool.size(), 1, [&](size_t begin, size_t end) {
+                for(auto i = begin; i < end; ++i)
+                    ++touched[i];
+            });
+        });
+
+    if(n <= config.max_pairwise_n)
+        bench.measure("calc_forces_tiled", n, threads, n * (n - 1.0) / 2.0, [&] {
+            consume(calc_forces_tiled(bodies.get_positions(), bodies.get_masses(), n, pool, G));
+        });
+
+    CollisionGrid grid;
+    bench.measure("collision_grid_build", n, threads, double(n), [&] {
+        grid.build(bodies.get_positions(), bodies.get_radii(), n, bodies.get_radius_max(), pool);
+    });
+
+    Bodies work = bodies;
+    auto& pairs = grid.get_pairs();
+    ConcurrentDisjointSet sets;
+    FlatGroups groups;
+    bench.measure("detect_collisions", n, threads, double(pairs.size()), [&] {
+        detect_collisions(work, pairs, sets, groups, pool);
+    });
+
+    bench.measure("resolve_collisions", n, threads, double(groups.size()),
+                  [&] { work = bodies; },
+                  [&] { resolve_collisions(work, groups, pool); });
+
+    bench.measure("bodies_compact", n, threads, double(n),
+                  [&] {
+                      work = bodies;
+                      for(size_t i = 0; i < n; i += 4)
+                          work.mark_dead(i);
+                  },
+                  [&] { work.compact(pool); });
+
+    work = bodies;
+    auto forces = calc_forces_cpu_simd(work, G, pool);
+    Integrator integrator({IntegrationScheme::Euler, 1.0f});
+    bench.measure("integrator_euler", n, threads, double(n), [&] {
+        integrator.step(work, G, [&](Bodies&) { return forces; }, pool);
+    });
+}
+
+// A tight binary inside a 1000 body halo, advanced by one dt: uniform Hermite
+// needs dt / 64 for the binary, block timesteps give only the binary the
+// fine steps. Items are the simulated intervals of length dt.
+void bench_block_timesteps(Bench& bench, const BenchConfig& config) {
+    float G = 1.0f;
+    float dt = 0.05f;
+    Bodies halo;
+    auto binary_velocity = 0.9f * std::sqrt(1.0f / 0.2f);
+    halo.add({-0.05f, 0.0f, 0.0f, 1.0f}, {0.0f, -binary_velocity, 0.0f, 0.0f}, 1.0f);
+    halo.add({0.05f, 0.0f, 0.0f, 1.0f}, {0.0f, binary_velocity, 0.0f, 0.0f}, 1.0f);
+    std::mt19937 rng(config.seed);
+    std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+    for(size_t i = 0; i < 1000; ++i) {
+        auto p = glm::normalize(glm::vec3(u(rng), u(rng), u(rng))) * (20.0f + 10.0f * u(rng));
+        glm::vec4 v{u(rng) * 0.05f, u(rng) * 0.05f, u(rng) * 0.05f, 0.0f};
+        halo.add(glm::vec4(p, 1.0f), v, 0.001f);
+    }
+
+    ThreadPool pool(1);
+    GravitySolverConfig gravity_config;
+    Bodies work;
+    std::optional<Integrator> integrator;
+    auto setup = [&](IntegratorConfig integrator_config) {
+        return [&, integrator_config] {
+            work = halo;
+            integrator.emplace(integrator_config);
+        };
+    };
+    bench.measure("hermite_uniform_dt64", halo.get_count(), 1, 1.0,
+                  setup({IntegrationScheme::Hermite, dt / 64.0f, 0}),
+                  [&] {
+                      for(size_t substep = 0; substep < 64; ++substep)
+                          compute_gravity_cpu(work, G, gravity_config, *integrator, pool);
+                  });
+    bench.measure("hermite_block_levels_6", halo.get_count(), 1, 1.0,
+                  setup({IntegrationScheme::Hermite, dt, 6}),
+                  [&] { compute_gravity_cpu(work, G, gravity_config, *integrator, pool); });
+}
+
+// The simulation thread against a render loop taking frames at 60 and 10 Hz.
+// A fixed tick rate should hold whatever the consumer does, and free running
+// throughput should not depend on it. Items are simulation steps, so
+// items_per_second is the achieved step rate.
+void bench_simulation_clock(Bench& bench, const BenchConfig& config) {
+    Bodies bodies;
+    ThreadPool pool(1);
+    InitialConditionsConfig ic_config;
+    ic_config.count = config.min_n;
+    ic_config.seed = config.seed;
+    generate_rotating_disk(bodies, ic_config, pool);
+    Bodies work;
+
+    auto run = [&](SimulationClockConfig clock_config, double consumer_rate, uint64_t steps) {
+        return [&, clock_config, consumer_rate, steps] {
+            CPUComputeRoutine routine(work, 1.0f, {}, {}, pool);
+            SimulationThread simulation(work, routine, clock_config);
+            std::atomic<bool> done{false};
+            std::thread consumer([&] {
+                size_t drawn = 0;
+                while(!done.load(std::memory_order_relaxed)) {
+                    if(simulation.acquire_frame())
+                        drawn += simulation.frame().count;
+                    std::this_thread::sleep_for(std::chrono::duration<double>(1.0 / consumer_rate));
+                }
+                volatile size_t sink = drawn;
+                (void)sink;
+            });
+            // polled apart from the consumer, so a slow consumer does not
+            // delay the end of the measurement
+            while(simulation.get_steps() < steps)
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            done.store(true, std::memory_order_relaxed);
+            consumer.join();
+        };
+    };
+    for(double consumer_rate : {60.0, 10.0}) {
+        auto consumer = "_consumer_" + std::to_string(int(consumer_rate)) + "hz";
+        bench.measure("simulation_tick_240hz" + consumer, bodies.get_count(), 1, 240.0,
+                      [&] { work = bodies; },
+                      run({240.0, 8}, consumer_rate, 240));
+        bench.measure("simulation_free" + consumer, bodies.get_count(), 1, 2000.0,
+                      [&] { work = bodies; },
+                      run({0.0, 8}, consumer_rate, 2000));
+    }
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    if(!parse_args(argc, argv, config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    Bench bench(config);
+    bench_block_timesteps(bench, config);
+    bench_simulation_clock(bench, config);
+    for(auto n = config.min_n; n <= config.max_n; n *= 4) {
+        Bodies bodies;
+        {
+            ThreadPool pool;
+            InitialConditionsConfig ic_config;
+            ic_config.count = n;
+            ic_config.seed = config.seed;
+            generate_rotating_disk(bodies, ic_config, pool);
+        }
+
+        bench_serial(bench, config, n, bodies);
+        for(auto threads : config.threads)
+            bench_threaded(bench, config, n, threads, bodies);
+    }
+
+    if(config.out.empty()) {
+        bench.write_json(std::cout);
+        return 0;
+    }
+    std::ofstream out(config.out);
+    bench.write_json(out);
+    return out ? 0 : 1;
+}
@@ -0,0 +1,535 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <gl_context/GLContext.hpp>
+
+#include "CPUComputeRoutine.hpp"
+#include "CPUGPUComputeRoutine.hpp"
+#include "ChunkedGPUComputeRoutine.hpp"
+#include "ComputeCPU.hpp"
+#include "ComputeGPU.hpp"
+#include "GLComputeShaders.hpp"
+#include "InitialConditions.hpp"
+
+// The GL compute checks. They run on a surfaceless EGL context, so no window
+// or display is needed; Mesa's llvmpipe runs them on machines without a GPU
+// (EGL_PLATFORM=surfaceless LIBGL_ALWAYS_SOFTWARE=1 forces it).
+
+bool make_context_current() {
+    auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+        eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    auto display = get_platform_display
+                 ? get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr)
+                 : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+        return false;
+    if(!eglBindAPI(EGL_OPENGL_API))
+        return false;
+    EGLint attributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    auto context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+    if(context == EGL_NO_CONTEXT)
+        return false;
+    return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+}
+
+// Runs one step of bodies on the GPU with the given kernel and one with the
+// CPU integrator and direct sum, and returns the largest difference of the
+// new velocities relative to the largest velocity change of the step.
+float check_gravity_gpu(const Bodies& bodies,
+                        float G,
+                        const IntegratorConfig& integrator,
+                        GravityKernelConfig kernel_config,
+                        ThreadPool& pool) {
+    auto count = bodies.get_count();
+    ArrayBufferObject positions_in, velocities_in, masses_in, positions_out, velocities_out;
+    positions_in.bind().init<glm::vec4>(count);
+    velocities_in.bind().init<glm::vec4>(count);
+    masses_in.bind().init<float>(count);
+    positions_out.bind().init<glm::vec4>(count);
+    velocities_out.bind().init<glm::vec4>(count);
+    positions_in.bind().update(bodies.get_positions(), count);
+    velocities_in.bind().update(bodies.get_velocities(), count);
+    masses_in.bind().update(bodies.get_masses(), count);
+
+    GravityComputeGPU gpu(kernel_config);
+    gpu.set_vbos(positions_in, velocities_in, masses_in, positions_out, velocities_out);
+    gpu.reserve(count);
+    gpu.calculate(count, G, integrator, false);
+    FencedReadback readback;
+    readback.request(velocities_out, count * sizeof(glm::vec4));
+    auto gpu_velocities = static_cast<const glm::vec4*>(readback.wait());
+
+    auto cpu = bodies;
+    Integrator cpu_integrator(integrator);
+    compute_gravity_cpu(cpu, G, {}, cpu_integrator, pool);
+
+    // velocity changes, the positions mostly show the old velocities
+    float largest_change = 1e-30f;
+    float error = 0.0f;
+    for(size_t i = 0; i < count; ++i) {
+        auto cpu_velocity = glm::vec3(cpu.get_velocities()[i]);
+        largest_change = std::max(largest_change, glm::distance(cpu_velocity, glm::vec3(bodies.get_velocities()[i])));
+        error = std::max(error, glm::distance(glm::vec3(gpu_velocities[i]), cpu_velocity));
+    }
+    return error / largest_change;
+}
+
+// every kernel and scheme against the CPU integrator; the body count is not
+// a multiple of the local size, so the last workgroup is partly out of range
+bool test_gravity_kernels(ThreadPool& pool) {
+    Bodies bodies;
+    InitialConditionsConfig ic_config;
+    ic_config.count = 1000;
+    generate_rotating_disk(bodies, ic_config, pool);
+
+    bool passed = true;
+    for(auto kernel : {GravityKernel::Simple, GravityKernel::Tiled}) {
+        for(auto scheme : integration_schemes) {
+            GravityKernelConfig kernel_config;
+            kernel_config.kernel = kernel;
+            IntegratorConfig config;
+            config.scheme = scheme;
+            auto error = check_gravity_gpu(bodies, ic_config.G, config, kernel_config, pool);
+            passed = passed && error < 1e-3f;
+            std::cerr << (kernel == GravityKernel::Tiled ? "tiled" : "simple") << " "
+                      << integration_scheme_name(scheme) << ": relative error " << error << "\n";
+        }
+    }
+    return passed;
+}
+
+// Several ping-pong steps of the cpu-gpu routine against the CPU routine. Two
+// bodies outside the disk close in on each other and merge after a few
+// steps, so the merge has to be resolved from the fenced position readback
+// and the state uploaded again for the steps after it to match.
+bool test_cpu_gpu_routine(ThreadPool& pool) {
+    Bodies bodies;
+    InitialConditionsConfig ic_config;
+    ic_config.count = 300;
+    generate_rotating_disk(bodies, ic_config, pool);
+    // radius 0.01 each, 0.08 apart closing at 0.02 per step
+    bodies.add({1.95f, 0.0f, 0.0f, 1.0f}, {0.01f, 0.0f, 0.0f, 0.0f}, 50.0f);
+    bodies.add({2.05f, 0.0f, 0.0f, 1.0f}, {-0.01f, 0.0f, 0.0f, 0.0f}, 50.0f);
+
+    auto cpu_bodies = bodies;
+    CPUComputeRoutine cpu(cpu_bodies, ic_config.G, {}, {}, pool);
+    ArrayBufferObject positions_render, radii_render;
+    positions_render.bind().init<glm::vec4>(bodies.get_count());
+    radii_render.bind().init<float>(bodies.get_count());
+    CPUGPUComputeRoutine gpu(bodies, positions_render, radii_render, ic_config.G, {}, pool);
+
+    bool passed = true;
+    size_t merge_step = 0;
+    for(size_t step = 1; step <= 12; ++step) {
+        auto count = bodies.get_count();
+        cpu.compute();
+        gpu.compute();
+        if(bodies.get_count() != cpu_bodies.get_count()) {
+            std::cerr << "step " << step << ": " << bodies.get_count() << " bodies, "
+                      << cpu_bodies.get_count() << " on the CPU\n";
+            return false;
+        }
+        if(bodies.get_count() < count && merge_step == 0) {
+            merge_step = step;
+            // the merged masses must be on the device for the next step
+            std::vector<float> masses(bodies.get_count());
+            gpu.vbo_masses.bind().download(masses, masses.size());
+            passed = passed && std::equal(masses.begin(), masses.end(), bodies.get_masses().begin());
+        }
+    }
+    if(merge_step < 2) {
+        std::cerr << "merged at step " << merge_step << ", expected a merge after some device steps\n";
+        return false;
+    }
+
+    gpu.sync_bodies();
+    float position_error = 0.0f;
+    float velocity_error = 0.0f;
+    float largest_velocity = 1e-30f;
+    for(size_t i = 0; i < bodies.get_count(); ++i) {
+        passed = passed && bodies.get_ids()[i] == cpu_bodies.get_ids()[i];
+        auto cpu_velocity = glm::vec3(cpu_bodies.get_velocities()[i]);
+        largest_velocity = std::max(largest_velocity, glm::length(cpu_velocity));
+        position_error = std::max(position_error, glm::distance(glm::vec3(bodies.get_positions()[i]),
+                                                                glm::vec3(cpu_bodies.get_positions()[i])));
+        velocity_error = std::max(velocity_error, glm::distance(glm::vec3(bodies.get_velocities()[i]), cpu_velocity));
+    }
+    velocity_error /= largest_velocity;
+    std::cerr << "merged at step " << merge_step << ", position error " << position_error
+              << ", relative velocity error " << velocity_error << "\n";
+    return passed && position_error < 1e-5f && velocity_error < 1e-5f;
+}
+
+// The cpu-gpu routine with the leapfrog and Hermite kernels against the CPU
+// integrator, on a cluster bound tightly enough that the scheme shows in
+// the velocities.
+bool test_cpu_gpu_integrators(ThreadPool& pool) {
+    Bodies initial;
+    InitialConditionsConfig ic_config;
+    ic_config.count = 200;
+    ic_config.G = 1.0f;
+    ic_config.seed = 7;
+    generate_plummer(initial, ic_config, pool);
+
+    bool passed = true;
+    for(auto scheme : {IntegrationScheme::Leapfrog, IntegrationScheme::Hermite}) {
+        IntegratorConfig integrator_config{scheme, 0.002f, 0, 0.02f};
+        auto bodies = initial;
+        auto cpu_bodies = initial;
+        CPUComputeRoutine cpu(cpu_bodies, ic_config.G, {}, integrator_config, pool);
+        ArrayBufferObject positions_render, radii_render;
+        positions_render.bind().init<glm::vec4>(bodies.get_count());
+        radii_render.bind().init<float>(bodies.get_count());
+        CPUGPUComputeRoutine gpu(bodies, positions_render, radii_render, ic_config.G, integrator_config, pool);
+        for(size_t step = 0; step < 10; ++step) {
+            cpu.compute();
+            gpu.compute();
+        }
+        gpu.sync_bodies();
+        if(bodies.get_count() != cpu_bodies.get_count()) {
+            std::cerr << integration_scheme_name(scheme) << ": " << bodies.get_count() << " bodies, "
+                      << cpu_bodies.get_count() << " on the CPU\n";
+            return false;
+        }
+
+        // against the velocity change of the run, the part the scheme decides
+        float largest_change = 1e-30f;
+        float error = 0.0f;
+        for(size_t i = 0; i < bodies.get_count(); ++i) {
+            auto cpu_velocity = glm::vec3(cpu_bodies.get_velocities()[i]);
+            auto slot = initial.get_slot(cpu_bodies.get_ids()[i]);
+            largest_change = std::max(largest_change, glm::distance(cpu_velocity, glm::vec3(initial.get_velocities()[slot])));
+            error = std::max(error, glm::distance(glm::vec3(bodies.get_velocities()[i]), cpu_velocity));
+        }
+        error /= largest_change;
+        std::cerr << integration_scheme_name(scheme) << ": relative velocity error " << error << "\n";
+        passed = passed && error < 1e-4f;
+    }
+
+    try {
+        auto bodies = initial;
+        ArrayBufferObject positions_render, radii_render;
+        CPUGPUComputeRoutine rejected(bodies, positions_render, radii_render, ic_config.G,
+                                      {IntegrationScheme::Hermite, 0.002f, 4, 0.02f}, pool);
+        std::cerr << "cpu-gpu took block timesteps\n";
+        passed = false;
+    } catch(const std::runtime_error&) {}
+    return passed;
+}
+
+template<typename T>
+void upload_vector(ArrayBufferObject& vbo, const std::vector<T>& values) {
+    vbo.bind().init<T>(values.size());
+    vbo.bind().update(values);
+}
+
+std::vector<glm::vec4> download_vec4(ArrayBufferObject& vbo, size_t count) {
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    std::vector<glm::vec4> values(count);
+    vbo.bind().download(values, count);
+    return values;
+}
+
+// 1 if got and expected differ by more than tolerance relative to scale
+int check(const char* test, size_t index, glm::vec3 got, glm::vec3 expected, float scale, float tolerance = 1e-5f) {
+    if(glm::distance(got, expected) <= tolerance * std::max(scale, 1e-30f))
+        return 0;
+    std::cerr << test << ": [" << index << "] got (" << got.x << ", " << got.y << ", " << got.z
+              << ") expected (" << expected.x << ", " << expected.y << ", " << expected.z << ")\n";
+    return 1;
+}
+
+bool test_force_shader(ThreadPool&) {
+    std::vector<glm::vec4> positions {
+        {0.0f, 0.0f, 0.0f, 1.0f},
+        {1.0f, 0.0f, 0.0f, 1.0f},
+        {2.0f, 0.0f, 0.0f, 1.0f},
+        {5.0f, 0.0f, 0.0f, 1.0f}
+    };
+    std::vector<float> masses{1.0f, 2.0f, 3.0f, 4.0f};
+    ArrayBufferObject vbo_positions, vbo_masses, vbo_forces;
+    upload_vector(vbo_positions, positions);
+    upload_vector(vbo_masses, masses);
+    upload_vector(vbo_forces, std::vector<glm::vec4>(16, glm::vec4{0.0f}));
+
+    ForceComputeShader shader;
+    shader.set_chunk_a(vbo_positions, vbo_masses);
+    shader.set_chunk_b(vbo_positions, vbo_masses);
+    shader.set_force_out(vbo_forces);
+    if(auto program = shader.use_program(); true) {
+        program.set_G(1.0f);
+        program.set_a_offset(0);
+        program.set_b_offset(0);
+        program.set_chunk_size(4);
+        shader.dispatch(4, 4, 1);
+    }
+    shader.barrier();
+
+    auto block = download_vec4(vbo_forces, 16);
+    int failures = 0;
+    for(size_t row = 0; row < 4; ++row) {
+        for(size_t col = 0; col < 4; ++col) {
+            auto diff = positions[col].x - positions[row].x;
+            auto force = diff == 0.0f ? 0.0f : std::copysign(masses[col] * masses[row] / (diff * diff), diff);
+            failures += check("force block", row * 4 + col, glm::vec3(block[row * 4 + col]), {force, 0.0f, 0.0f}, 8.0f);
+        }
+    }
+    return failures == 0;
+}
+
+// the two chunks in one buffer, then in two
+bool test_total_force_shader(ThreadPool&) {
+    std::vector<glm::vec4> block;
+    for(float value : {1, 2, 3, 4, 5, 6, 7, 8, 9, 1, 2, 3, 4, 5, 6, 7})
+        block.push_back(glm::vec4{value});
+    std::vector<glm::vec4> totals;
+    for(float value : {100, 200, 300, 400, -500, -600, -700, -800})
+        totals.push_back(glm::vec4{value});
+    auto expected = totals;
+    for(size_t id = 0; id < 4; ++id) {
+        for(size_t i = 0; i < 4; ++i) {
+            expected[id] -= block[i * 4 + id];
+            expected[4 + id] += block[id * 4 + i];
+        }
+    }
+
+    int failures = 0;
+    for(bool split : {false, true}) {
+        ArrayBufferObject vbo_block, vbo_totals, vbo_totals_b;
+        upload_vector(vbo_block, block);
+        upload_vector(vbo_totals, totals);
+        upload_vector(vbo_totals_b, std::vector<glm::vec4>(totals.begin() + 4, totals.end()));
+
+        TotalForceComputeShader shader;
+        shader.set_force_in(vbo_block);
+        shader.set_force_out(vbo_totals, split ? vbo_totals_b : vbo_totals);
+        if(auto program = shader.use_program(); true) {
+            program.set_a_offset(0);
+            program.set_b_offset(split ? 0 : 4);
+            program.set_chunk_size(4);
+            program.set_diagonal(false);
+            shader.dispatch(4, 1, 1);
+        }
+        shader.barrier();
+
+        auto result = download_vec4(vbo_totals, 8);
+        if(split) {
+            auto result_b = download_vec4(vbo_totals_b, 4);
+            std::copy(result_b.begin(), result_b.end(), result.begin() + 4);
+        }
+        for(size_t i = 0; i < 8; ++i)
+            failures += check("total force", i, glm::vec3(result[i]), glm::vec3(expected[i]), 800.0f);
+    }
+    return failures == 0;
+}
+
+bool test_update_position_velocity_shader(ThreadPool&) {
+    std::vector<glm::vec4> positions{glm::vec4(1.0f), glm::vec4(2.0f), glm::vec4(3.0f), glm::vec4(4.0f)};
+    std::vector<glm::vec4> velocities{glm::vec4(5.0f), glm::vec4(6.0f), glm::vec4(7.0f), glm::vec4(8.0f)};
+    std::vector<float> masses{1.0f, 2.0f, 0.0f, 4.0f};
+    std::vector<glm::vec4> forces{glm::vec4(1.0f), glm::vec4(2.0f), glm::vec4(3.0f), glm::vec4(4.0f)};
+    float dt = 0.5f;
+    ArrayBufferObject vbo_positions, vbo_velocities, vbo_masses, vbo_forces, vbo_positions_out, vbo_velocities_out;
+    upload_vector(vbo_positions, positions);
+    upload_vector(vbo_velocities, velocities);
+    upload_vector(vbo_masses, masses);
+    upload_vector(vbo_forces, forces);
+    upload_vector(vbo_positions_out, std::vector<glm::vec4>(4, glm::vec4{0.0f}));
+    upload_vector(vbo_velocities_out, std::vector<glm::vec4>(4, glm::vec4{0.0f}));
+
+    UpdatePositionVelocityComputeShader shader;
+    shader.set_position_in(vbo_positions);
+    shader.set_velocity_in(vbo_velocities);
+    shader.set_mass_in(vbo_masses);
+    shader.set_force_in(vbo_forces);
+    shader.set_position_out(vbo_positions_out);
+    shader.set_velocity_out(vbo_velocities_out);
+    // two dispatches, to cover the offset
+    for(GLint offset : {0, 2}) {
+        if(auto program = shader.use_program(); true) {
+            program.set_offset(offset);
+            program.set_dt(dt);
+            shader.dispatch(2, 1, 1);
+        }
+    }
+    shader.barrier();
+
+    auto positions_out = download_vec4(vbo_positions_out, 4);
+    auto velocities_out = download_vec4(vbo_velocities_out, 4);
+    int failures = 0;
+    for(size_t i = 0; i < 4; ++i) {
+        auto velocity = glm::vec3(velocities[i]);
+        if(masses[i] > 0.0f)
+            velocity += glm::vec3(forces[i]) / masses[i] * dt;
+        auto position = glm::vec3(positions[i]) + velocity * dt;
+        failures += check("updated velocity", i, glm::vec3(velocities_out[i]), velocity, 10.0f);
+        failures += check("updated position", i, glm::vec3(positions_out[i]), position, 10.0f);
+    }
+    return failures == 0;
+}
+
+// the whole pipeline against the CPU direct sum, N not a multiple of chunk
+int check_chunked_gravity(ChunkedGravityConfig config, ThreadPool& pool) {
+    Bodies bodies;
+    InitialConditionsConfig ic_config;
+    ic_config.count = 37;
+    ic_config.seed = 3;
+    generate_plummer(bodies, ic_config, pool);
+    float G = 1.0f;
+    float dt = 0.01f;
+
+    ChunkedGravityGPU gpu(config);
+    gpu.upload(bodies);
+    gpu.calculate_forces(bodies.get_count(), G);
+    auto forces = gpu.download_forces(bodies.get_count());
+
+    auto expected = calc_forces_cpu(bodies, G);
+    float largest = 0.0f;
+    for(auto& force : expected)
+        largest = std::max(largest, glm::length(glm::vec3(force)));
+    int failures = 0;
+    for(size_t i = 0; i < bodies.get_count(); ++i)
+        failures += check("chunked force", i, glm::vec3(forces[i]), glm::vec3(expected[i]), largest, 1e-4f);
+
+    gpu.step(bodies.get_count(), G, dt);
+    auto stepped = bodies;
+    gpu.download(stepped);
+    Integrator integrator({IntegrationScheme::Euler, dt});
+    integrator.step(bodies, G, [&](Bodies& b) { return calc_forces_cpu(b, G); }, pool);
+    for(size_t i = 0; i < bodies.get_count(); ++i)
+        failures += check("chunked step", i, glm::vec3(stepped.get_positions()[i]), glm::vec3(bodies.get_positions()[i]), 1.0f, 1e-4f);
+    return failures;
+}
+
+bool test_chunked_gravity(ThreadPool& pool) {
+    ChunkedGravityConfig config;
+    config.chunk_size = 8;
+    return check_chunked_gravity(config, pool) == 0;
+}
+
+// the per-body state split as if a texture buffer held only 16 bodies, so
+// blocks pair chunks of different buffers
+bool test_chunked_gravity_segments(ThreadPool& pool) {
+    ChunkedGravityConfig config;
+    config.chunk_size = 8;
+    config.segment_size = 16;
+    ChunkedGravityGPU gpu(config);
+    Bodies bodies;
+    InitialConditionsConfig ic_config;
+    ic_config.count = 37;
+    generate_plummer(bodies, ic_config, pool);
+    gpu.upload(bodies);
+    if(gpu.get_segment_count() != 3) {
+        std::cerr << gpu.get_segment_count() << " segments, expected 3\n";
+        return false;
+    }
+    return check_chunked_gravity(config, pool) == 0;
+}
+
+// the routine steps with the configured dt like the CPU Euler routine, and
+// refuses the schemes the pipeline cannot take
+bool test_chunked_gpu_routine(ThreadPool& pool) {
+    Bodies bodies;
+    InitialConditionsConfig ic_config;
+    ic_config.count = 100;
+    ic_config.seed = 5;
+    generate_plummer(bodies, ic_config, pool);
+    float G = 1.0f;
+    IntegratorConfig integrator_config{IntegrationScheme::Euler, 0.001f, 0, 0.02f};
+
+    auto cpu_bodies = bodies;
+    CPUComputeRoutine cpu(cpu_bodies, G, {}, integrator_config, pool);
+    ArrayBufferObject positions_render, radii_render;
+    positions_render.bind().init<glm::vec4>(bodies.get_count());
+    radii_render.bind().init<float>(bodies.get_count());
+    ChunkedGravityConfig chunked_config;
+    chunked_config.chunk_size = 32;
+    ChunkedGPUComputeRoutine gpu(bodies, positions_render, radii_render, G, integrator_config, pool, chunked_config);
+    for(size_t step = 0; step < 5; ++step) {
+        cpu.compute();
+        gpu.compute();
+    }
+
+    int failures = 0;
+    if(bodies.get_count() != cpu_bodies.get_count()) {
+        std::cerr << bodies.get_count() << " bodies, " << cpu_bodies.get_count() << " on the CPU\n";
+        return false;
+    }
+    auto rendered = download_vec4(positions_render, bodies.get_count());
+    for(size_t i = 0; i < bodies.get_count(); ++i) {
+        auto expected = glm::vec3(cpu_bodies.get_positions()[i]);
+        failures += check("chunked routine", i, glm::vec3(bodies.get_positions()[i]), expected, 1.0f, 1e-4f);
+        failures += check("chunked render", i, glm::vec3(rendered[i]), glm::vec3(bodies.get_positions()[i]), 1.0f, 0.0f);
+    }
+
+    for(auto scheme : {IntegrationScheme::Leapfrog, IntegrationScheme::Hermite}) {
+        try {
+            ChunkedGPUComputeRoutine rejected(bodies, positions_render, radii_render, G, {scheme, 0.001f, 0, 0.02f}, pool);
+            std::cerr << "chunked routine took " << integration_scheme_name(scheme) << " steps\n";
+            ++failures;
+        } catch(const std::runtime_error&) {}
+    }
+    return failures == 0;
+}
+
+struct GLTest {
+    const char* name;
+    std::function<bool(ThreadPool&)> run;
+};
+
+const GLTest gl_tests[] = {
+    {"gravity_kernels", test_gravity_kernels},
+    {"cpu_gpu_routine", test_cpu_gpu_routine},
+    {"cpu_gpu_integrators", test_cpu_gpu_integrators},
+    {"force_shader", test_force_shader},
+    {"total_force_shader", test_total_force_shader},
+    {"update_position_velocity_shader", test_update_position_velocity_shader},
+    {"chunked_gravity", test_chunked_gravity},
+    {"chunked_gravity_segments", test_chunked_gravity_segments},
+    {"chunked_gpu_routine", test_chunked_gpu_routine},
+};
+
+int main(int argc, char** argv) {
+    std::vector<std::string> names(argv + 1, argv + argc);
+    for(auto& name : names) {
+        if(std::none_of(std::begin(gl_tests), std::end(gl_tests), [&](auto& test) { return name == test.name; })) {
+            std::cerr << "usage: " << argv[0] << " [test ...]\n  tests:";
+            for(auto& test : gl_tests)
+                std::cerr << " " << test.name;
+            std::cerr << "\n";
+            return 1;
+        }
+    }
+    if(!make_context_current()) {
+        std::cerr << "no surfaceless EGL context with OpenGL 4.5 core\n";
+        return 1;
+    }
+    GLContext::get();
+    std::cerr << glGetString(GL_RENDERER) << " | " << glGetString(GL_VERSION) << "\n";
+
+    ThreadPool pool;
+    size_t failures = 0;
+    for(auto& test : gl_tests) {
+        if(!names.empty() && std::find(names.begin(), names.end(), test.name) == names.end())
+            continue;
+        bool passed = false;
+        try {
+            passed = test.run(pool);
+        } catch(const std::exception& e) {
+            std::cerr << test.name << ": " << e.what() << "\n";
+        }
+        std::cerr << test.name << (passed ? ": passed\n" : ": FAILED\n");
+        failures += !passed;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "CPUComputeRoutine.hpp"
+#include "InitialConditions.hpp"
+#include "Profiler.hpp"
+#include "Snapshot.hpp"
+#include "Trajectory.hpp"
+#include "Utils.hpp"
+
+struct HeadlessConfig {
+    size_t bodies = 1024;
+    float G = 0.000000001f;
+    size_t threads = std::thread::hardware_concurrency();
+    size_t steps = 100;
+    std::string ic = "disk";
+    InitialConditionsConfig ic_config;
+    GravitySolverConfig gravity_config;
+    // picks the fastest solver at startup instead of gravity_config.solver
+    bool calibrate = false;
+    IntegratorConfig integrator_config;
+    std::string trace;
+    std::string load;
+    std::string save;
+    std::string trajectory;
+    TrajectoryConfig trajectory_config;
+};
+
+void print_usage(const char* name) {
+    std::cerr << "usage: " << name << " [options]\n"
+              << "  --bodies N      number of bodies (1024)\n"
+              << "  --G G           gravitational constant (1e-9)\n"
+              << "  --threads T     worker threads (hardware concurrency)\n"
+              << "  --steps S       steps to run (100)\n"
+              << "  --seed X        initial conditions seed (1)\n"
+              << "  --ic NAME       disk | plummer | exp-disk | cloud (disk)\n"
+              << "  --scale S       size of the initial distribution (1)\n"
+              << "  --solver NAME   direct | simd | barnes-hut | fmm | pm | auto (direct)\n"
+              << "  --integrator NAME       euler | leapfrog | hermite (euler), hermite needs --solver direct\n"
+              << "  --dt DT         integrator timestep (1)\n"
+              << "  --block-levels L        Hermite block timestep levels, at most 30 (0)\n"
+              << "  --trace FILE    Chrome trace of the phases (profiling builds)\n"
+              << "  --load FILE     continue from a snapshot instead of --bodies/--seed, its\n"
+              << "                  integrator settings replace --integrator/--dt/--block-levels\n"
+              << "  --save FILE     write a snapshot after the last step\n"
+              << "  --trajectory FILE       stream quantized positions of every step\n"
+              << "  --keyframe-interval K   frames between trajectory keyframes (64)\n";
+}
+
+bool parse_args(int argc, char** argv, HeadlessConfig& config) {
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--help" || arg == "-h" || i + 1 >= argc)
+            return false;
+        std::string value = argv[++i];
+        try {
+            if(arg == "--bodies")
+                config.bodies = std::stoul(value);
+            else if(arg == "--G")
+                config.G = std::stof(value);
+            else if(arg == "--threads")
+                config.threads = std::stoul(value);
+            else if(arg == "--steps")
+                config.steps = std::stoul(value);
+            else if(arg == "--seed")
+                config.ic_config.seed = std::stoull(value);
+            else if(arg == "--ic")
+                config.ic = value;
+            else if(arg == "--scale")
+                config.ic_config.scale = std::stof(value);
+            else if(arg == "--trace")
+                config.trace = value;
+            else if(arg == "--load")
+                config.load = value;
+            else if(arg == "--save")
+                config.save = value;
+            else if(arg == "--trajectory")
+                config.trajectory = value;
+            else if(arg == "--keyframe-interval")
+                config.trajectory_config.keyframe_interval = std::stoul(value);
+            else if(arg == "--dt")
+                config.integrator_config.dt = std::stof(value);
+            else if(arg == "--block-levels")
+                config.integrator_config.block_levels = std::stoul(value);
+            else if(arg == "--integrator") {
+                if(!parse_integration_scheme(value, config.integrator_config.scheme))
+                    return false;
+            }
+            else if(arg == "--solver") {
+                config.calibrate = value == "auto";
+                if(!config.calibrate && !parse_gravity_solver(value, config.gravity_config.solver))
+                    return false;
+            }
+            else
+                return false;
+        } catch(const std::exception&) {
+            return false;
+        }
+    }
+    if(!config.calibrate && !solver_supports_scheme(config.gravity_config.solver, config.integrator_config.scheme))
+        return false;
+    if(config.integrator_config.block_levels > max_block_levels)
+        return false;
+    return config.threads > 0;
+}
+
+bool generate_bodies(Bodies& bodies, HeadlessConfig& config, ThreadPool& pool) {
+    config.ic_config.count = config.bodies;
+    config.ic_config.G = config.G;
+    if(config.ic == "disk")
+        generate_rotating_disk(bodies, config.ic_config, pool);
+    else if(config.ic == "plummer")
+        generate_plummer(bodies, config.ic_config, pool);
+    else if(config.ic == "exp-disk")
+        generate_exponential_disk(bodies, config.ic_config, pool);
+    else if(config.ic == "cloud")
+        generate_uniform_cloud(bodies, config.ic_config, pool);
+    else
+        return false;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    HeadlessConfig config;
+    if(!parse_args(argc, argv, config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    ThreadPool pool(config.threads);
+    Bodies bodies;
+    SimulationState state;
+    try {
+        if(config.load.empty()) {
+            Timer<std::chrono::duration<double, std::milli>> generate_timer;
+            if(!generate_bodies(bodies, config, pool)) {
+                print_usage(argv[0]);
+                return 1;
+            }
+            std::cout << "generated " << config.bodies << " bodies (" << config.ic << ") in "
+                      << generate_timer.elapsed().count() << " ms\n";
+        } else {
+            Timer<std::chrono::duration<double, std::milli>> load_timer;
+            state = load_snapshot(bodies, config.load);
+            config.bodies = bodies.get_count();
+            config.integrator_config = state.integrator.config;
+            std::cout << "loaded " << config.load << " in " << load_timer.elapsed().count() << " ms, step "
+                      << state.step << ", time " << state.time << "\n";
+        }
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    std::unique_ptr<TrajectoryWriter> trajectory;
+    if(!config.trajectory.empty()) {
+        try {
+            trajectory = std::make_unique<TrajectoryWriter>(config.trajectory, config.trajectory_config);
+        } catch(const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+
+    ComputeRoutineRegistry registry;
+    for(auto solver : gravity_solvers) {
+        if(!solver_supports_scheme(solver, config.integrator_config.scheme))
+            continue;
+        auto gravity_config = config.gravity_config;
+        gravity_config.solver = solver;
+        registry.add(gravity_solver_name(solver), [&, gravity_config] {
+            return std::make_unique<CPUComputeRoutine>(bodies, config.G, gravity_config, config.integrator_config, pool);
+        });
+    }
+    std::unique_ptr<ComputeRoutine> routine;
+    try {
+        if(!config.calibrate && !solver_supports_scheme(config.gravity_config.solver, config.integrator_config.scheme))
+            throw std::runtime_error(std::string("the ") + integration_scheme_name(config.integrator_config.scheme)
+                                     + " integrator needs --solver direct");
+        if(config.calibrate)
+            routine = std::make_unique<CalibratingRoutine>(registry, bodies);
+        else
+            routine = registry.create(gravity_solver_name(config.gravity_config.solver));
+    } catch(const std::exception& e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    // calibration switches integrators on its own, so a calibrating run
+    // continues from the bodies only
+    if(!config.load.empty() && routine->get_integrator())
+        routine->get_integrator()->set_state(state.integrator);
+
+    double pair_interactions = 0.0;
+    Timer<std::chrono::duration<double>> timer;
+    for(size_t step = 0; step < config.steps; ++step) {
+        // direct-sum equivalent, whatever the solver, before the merges of
+        // this step
+        auto count = double(bodies.get_count());
+        pair_interactions += count * (count - 1.0) / 2.0;
+        routine->compute();
+        state.time += config.integrator_config.dt;
+        ++state.step;
+        if(trajectory) {
+            PROFILE_SCOPE("trajectory_push");
+            // numbered like snapshots, by the steps done, across --load
+            trajectory->push(bodies, state.step);
+        }
+    }
+    auto seconds = timer.elapsed().count();
+
+    std::cout << "bodies " << config.bodies << " -> " << bodies.get_count()
+              << ", threads " << config.threads
+              << ", steps " << config.steps << "\n"
+              << "time " << seconds << " s, "
+              << config.steps / seconds << " steps/s, "
+              << pair_interactions / seconds << " pair interactions/s\n"
+              << "simulated up to step " << state.step << ", time " << state.time << "\n";
+
+    if(trajectory) {
+        trajectory->close();
+        std::cout << "trajectory: " << trajectory->get_written() << " frames written, "
+                  << trajectory->get_dropped() << " dropped\n";
+        if(trajectory->has_failed()) {
+            std::cerr << "failed to write " << config.trajectory << "\n";
+            return 1;
+        }
+    }
+
+    if(!config.save.empty()) {
+        try {
+            auto integrator = routine->get_integrator();
+            state.integrator = integrator ? integrator->get_state() : IntegratorState{config.integrator_config, false, {}, {}, {}};
+            save_snapshot(bodies, config.save, state);
+        } catch(const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+
+#ifdef GRAVITY_PROFILING
+    write_profile_summary(std::cerr);
+#endif
+    if(!config.trace.empty()) {
+        std::ofstream trace(config.trace);
+        write_chrome_trace(trace);
+        if(!trace) {
+            std::cerr << "failed to write " << config.trace << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}